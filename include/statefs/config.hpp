@@ -54,7 +54,8 @@ public:
 
     Property(std::string const &name,
              property_type const &defval,
-             unsigned access = Read);
+             unsigned access = Read,
+             long min_interval = -1);
 
     std::string defval() const;
 
@@ -65,9 +66,23 @@ public:
 
     int mode(int umask = 0027) const;
 
+    /// minimal interval (ms) between change notifications, 0 - no limit
+    long min_interval() const
+    {
+        return (min_interval_ > 0) ? min_interval_ : 0;
+    }
+
+    /// used to apply namespace-wide option if property has no own one
+    void min_interval_default(long interval)
+    {
+        if (min_interval_ < 0)
+            min_interval_ = interval;
+    }
+
 private:
     property_type defval_;
     unsigned access_;
+    long min_interval_;
 };
 
 class Namespace : public nl::ObjectExpr
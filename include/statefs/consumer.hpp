@@ -9,6 +9,12 @@
 
 #include <cor/util.hpp>
 
+#include <functional>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
 namespace statefs { namespace consumer {
 
 /**
@@ -20,17 +26,19 @@ namespace statefs { namespace consumer {
  *  @{
  */
 
-// enum class Flow
-// {
-//     Continue, Stop
-// };
+/// receiver return value: should property be monitored further
+enum class Flow
+{
+    Continue, Stop
+};
 
-// enum class Status
-// {
-//     NotExists, Error, Ok 
-// };
+enum class Status
+{
+    NotExists, Error, Ok
+};
 
-// typedef std::function<Flow (Status, std;:string const &)> receiver_type;
+/// receives property value (or error description)
+typedef std::function<Flow (Status, std::string const &)> receiver_type;
 
 enum class Prefer {
     User, Sys, OnlyUser, OnlySys
@@ -39,8 +47,73 @@ enum class Prefer {
 cor::FdHandle try_open_in_property
 (std::string const&, Prefer prefer = Prefer::User);
 
-// void monitor_path(std::string const&, receiver_type);
-// void monitor_property(std::string const&, receiver_type);
+/**
+ * Monitors many properties using single epoll set. Property value
+ * is read (with pread from the beginning, w/o reopening the file)
+ * when it is changed and receivers of all changed properties are
+ * called together after values are read. Initial value is reported
+ * on the first process() call.
+ *
+ * Monitor is not thread-safe.
+ */
+class Monitor
+{
+public:
+    Monitor();
+    ~Monitor();
+
+    Monitor(Monitor const&) = delete;
+    Monitor& operator = (Monitor const&) = delete;
+
+    /// @return false if property file can't be opened, receiver is
+    /// called with NotExists status in this case
+    bool add_path(std::string const &, receiver_type);
+    bool add_property(std::string const &, receiver_type
+                      , Prefer prefer = Prefer::User);
+
+    /**
+     * wait for changes and dispatch them
+     *
+     * @param timeout in milliseconds, -1 - infinite
+     *
+     * @return number of dispatched changes or -errno
+     */
+    int process(int timeout = -1);
+
+    /// process changes until all receivers return Flow::Stop
+    void run();
+
+    bool empty() const
+    {
+        return items_.empty();
+    }
+
+private:
+
+    struct Item
+    {
+        Item(cor::FdHandle &&h, receiver_type const &r)
+            : fd(std::move(h)), receiver(r)
+        {}
+
+        cor::FdHandle fd;
+        receiver_type receiver;
+    };
+
+    bool add(cor::FdHandle &&, receiver_type const &);
+    void remove(int fd);
+    int read(Item &);
+
+    cor::FdHandle epoll_;
+    std::map<int, std::unique_ptr<Item> > items_;
+    std::vector<char> buf_;
+};
+
+/// monitors property file until receiver returns Flow::Stop
+void monitor_path(std::string const&, receiver_type);
+/// monitors property (with full name "ns.name") until receiver
+/// returns Flow::Stop
+void monitor_property(std::string const&, receiver_type);
 
 
 /** @}
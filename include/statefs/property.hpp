@@ -13,6 +13,10 @@
 #include <string>
 #include <mutex>
 #include <array>
+#include <type_traits>
+
+#include <stdio.h>
+#include <stdlib.h>
 
 namespace statefs {
 
@@ -37,6 +41,9 @@ int read_from(T &src, char *dst, statefs_size_t len, statefs_off_t off)
     return len;
 }
 
+/// view referencing immutable value, see statefs_io.read_view
+int value_view(std::shared_ptr<std::string const> const &, ::statefs_view *);
+
 class DiscreteProperty;
 setter_type property_setter(std::shared_ptr<DiscreteProperty> const &);
 
@@ -91,6 +98,7 @@ public:
     bool connect(::statefs_slot *slot) { return false; }
 
     int read(std::string *h, char *dst, statefs_size_t len, statefs_off_t);
+    int read_view(std::string *h, ::statefs_view *);
 
     int write(std::string *h, char const *src
               , statefs_size_t len, statefs_off_t off)
@@ -122,6 +130,7 @@ public:
     statefs_ssize_t size() const;
     bool connect(::statefs_slot *);
     int read(std::string *, char *, statefs_size_t, statefs_off_t);
+    int read_view(std::string *, ::statefs_view *);
 
     int write(std::string *, char const *, statefs_size_t, statefs_off_t)
     {
@@ -138,11 +147,24 @@ private:
 
     statefs::AProperty *parent_;
     mutable std::mutex m_;
-    std::string v_;
+    // immutable, replaced on update, so it can be referenced by views
+    std::shared_ptr<std::string const> v_;
 
     ::statefs_slot *slot_;
 };
 
+static inline int property_read_view
+(AnalogProperty &p, std::string *h, ::statefs_view *view)
+{
+    return p.read_view(h, view);
+}
+
+static inline int property_read_view
+(DiscreteProperty &p, std::string *h, ::statefs_view *view)
+{
+    return p.read_view(h, view);
+}
+
 template <typename T>
 struct PropTraits
 {
@@ -287,6 +309,196 @@ static inline std::string statefs_attr(bool v)
     return std::to_string(v ? 1 : 0);
 }
 
+/// the shortest of %.15g and %.17g forms read back as the same value
+static inline std::string statefs_attr(double v)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.15g", v);
+    if (strtod(buf, nullptr) != v)
+        snprintf(buf, sizeof(buf), "%.17g", v);
+    return buf;
+}
+
+static inline ::statefs_variant statefs_variant_from(long v)
+{
+    ::statefs_variant res;
+    res.tag = statefs_variant_int;
+    res.i = v;
+    return res;
+}
+
+static inline ::statefs_variant statefs_variant_from(unsigned long v)
+{
+    ::statefs_variant res;
+    res.tag = statefs_variant_uint;
+    res.u = v;
+    return res;
+}
+
+static inline ::statefs_variant statefs_variant_from(int v)
+{
+    return statefs_variant_from((long)v);
+}
+
+static inline ::statefs_variant statefs_variant_from(unsigned v)
+{
+    return statefs_variant_from((unsigned long)v);
+}
+
+static inline ::statefs_variant statefs_variant_from(double v)
+{
+    ::statefs_variant res;
+    res.tag = statefs_variant_real;
+    res.r = v;
+    return res;
+}
+
+static inline ::statefs_variant statefs_variant_from(bool v)
+{
+    ::statefs_variant res;
+    res.tag = statefs_variant_bool;
+    res.b = v;
+    return res;
+}
+
+/**
+ * Discrete property storing native value (int, long, unsigned,
+ * unsigned long, double, bool). Values are compared natively on
+ * update, text form is formatted only when value is read and cached
+ * until the next change. Default value reported to introspection has
+ * the native type
+ */
+template <typename T>
+class DiscreteValue
+{
+    static_assert(std::is_same<T, int>::value
+                  || std::is_same<T, long>::value
+                  || std::is_same<T, unsigned>::value
+                  || std::is_same<T, unsigned long>::value
+                  || std::is_same<T, double>::value
+                  || std::is_same<T, bool>::value
+                  , "DiscreteValue supports only int, long, unsigned,"
+                  " unsigned long, double and bool");
+public:
+    typedef std::function<PropertyStatus (T const&)> setter_type;
+
+    DiscreteValue(statefs::AProperty *parent, T const &defval)
+        : parent_(parent), v_(defval), slot_(nullptr)
+    {
+        parent_->default_value = statefs_variant_from(defval);
+    }
+
+    DiscreteValue(DiscreteValue const&) =delete;
+    void operator =(DiscreteValue const&) =delete;
+
+    int getattr() const
+    {
+        return STATEFS_ATTR_READ | STATEFS_ATTR_DISCRETE;
+    }
+
+    statefs_ssize_t size() const
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        return (statefs_ssize_t)text()->size();
+    }
+
+    bool connect(::statefs_slot *slot)
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        slot_ = slot;
+        return true;
+    }
+
+    void disconnect()
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        slot_ = nullptr;
+    }
+
+    int read(std::string *h, char *dst, statefs_size_t len, statefs_off_t off)
+    {
+        if (!off) {
+            std::lock_guard<std::mutex> lock(m_);
+            *h = *text();
+        }
+        return read_from(*h, dst, len, off);
+    }
+
+    int read_view(std::string *, ::statefs_view *view)
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        return value_view(text(), view);
+    }
+
+    int write(std::string *, char const *, statefs_size_t, statefs_off_t)
+    {
+        return -1;
+    }
+
+    void release() {}
+
+    PropertyStatus update(T const &v)
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        if (v_ == v)
+            return PropertyUnchanged;
+
+        v_ = v;
+        text_.reset();
+        if (slot_)
+            slot_->on_changed(slot_, parent_);
+        return PropertyUpdated;
+    }
+
+    T value() const
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        return v_;
+    }
+
+private:
+
+    /// should be called with lock held
+    std::shared_ptr<std::string const> const& text() const
+    {
+        if (!text_)
+            text_ = std::make_shared<std::string const>(statefs_attr(v_));
+        return text_;
+    }
+
+    statefs::AProperty *parent_;
+    mutable std::mutex m_;
+    T v_;
+    // formatted on demand, immutable, so it can be referenced by views
+    mutable std::shared_ptr<std::string const> text_;
+    ::statefs_slot *slot_;
+};
+
+template <typename T>
+int property_read_view
+(DiscreteValue<T> &p, std::string *h, ::statefs_view *view)
+{
+    return p.read_view(h, view);
+}
+
+template <typename T>
+std::shared_ptr<BasicPropertyOwner<DiscreteValue<T>, std::string> >
+create_value(std::string const &name, T const &defval)
+{
+    typedef BasicPropertyOwner<DiscreteValue<T>, std::string> h_type;
+    return std::make_shared<h_type>(name, defval);
+}
+
+template <typename T>
+typename DiscreteValue<T>::setter_type setter
+(std::shared_ptr<BasicPropertyOwner<DiscreteValue<T>, std::string> > const& h)
+{
+    auto p = h->get_impl();
+    return [p](T const &v) {
+        return p->update(v);
+    };
+}
+
 /// Using functor returning std::string as the source
 class FunctionSource : public PropertySource
 {
@@ -350,6 +562,7 @@ public:
                 *this << create(std::move(Analog{name, defval}), std::move(src));
             }
         }
+        freeze();
     }
 
     void set(PropId id, std::string const &v)
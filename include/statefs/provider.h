@@ -167,6 +167,49 @@ struct statefs_property
 /** discrete, statefs_slot can be connected using statefs_io.connect */
 #define STATEFS_ATTR_DISCRETE (1 << 2)
 
+/**
+ * Immutable property value buffer owned by provider. Buffer should
+ * not be changed or freed until server calls release, it can happen
+ * from any thread and after the handle is closed.
+ */
+struct statefs_view
+{
+    /** value data, not 0-terminated */
+    char const *data;
+    /** value length */
+    statefs_size_t len;
+    /**
+     * if not NULL - called by server when data is not used anymore,
+     * e.g. to decrement buffer reference counter
+     */
+    void (*release)(struct statefs_view *);
+    /** provider context, e.g. pointer to the reference counted buffer */
+    void *ctx;
+};
+
+/**
+ * Property attributes and value slice filled by statefs_io.read_many
+ */
+struct statefs_slice
+{
+    /** property to be read, set by caller */
+    struct statefs_property *property;
+    /**
+     * destination buffer set by caller, can be NULL if only
+     * attributes are requested
+     */
+    char *data;
+    /** destination buffer size, set by caller */
+    statefs_size_t size;
+    /**
+     * set by provider: number of bytes copied or negative error
+     * code. If it is equal to size the value can be truncated
+     */
+    statefs_ssize_t len;
+    /** set by provider: property attributes, see statefs_io.getattr */
+    int attr;
+};
+
 /**
  * API to access properties. The API itself can be accessed
  * concurently but access to separate properties and opened property
@@ -218,6 +261,31 @@ struct statefs_io
     bool (*connect)(struct statefs_property *, struct statefs_slot *);
     /** disconnect previously connected slot */
     void (*disconnect)(struct statefs_property *);
+
+    /**
+     * Optional, can be NULL, available since version 3.1 (check
+     * statefs_has_read_view()). Get the whole property value w/o
+     * copying it into server buffer, server reads the value from the
+     * view and releases it.
+     *
+     * @retval 0 on success or negative error code, -ENOTSUP means
+     * value should be read using read()
+     */
+    int (*read_view)(statefs_handle_t, struct statefs_view *);
+
+    /**
+     * Optional, can be NULL, available since version 3.2 (check
+     * statefs_has_read_many()). Get attributes and values of several
+     * namespace properties at once. Values are read from the
+     * beginning. Provider can read values under the single lock to
+     * make them consistent but it is not required: statefs-pp
+     * implementation reads properties one by one.
+     *
+     * @param ns namespace of slice properties
+     * @retval number of filled slices or negative error code
+     */
+    int (*read_many)(struct statefs_namespace *ns,
+                     struct statefs_slice *slices, statefs_size_t count);
 };
 
 /**
@@ -293,7 +361,12 @@ static inline char const *statefs_provider_accessor()
  * if provider logic is changed and it can't be used with previous
  * versions of consumer safely
  */
-#define STATEFS_CURRENT_VERSION STATEFS_MK_VERSION(3, 0)
+#define STATEFS_CURRENT_VERSION STATEFS_MK_VERSION(3, 2)
+
+/** the first version with statefs_io.read_view */
+#define STATEFS_READ_VIEW_VERSION STATEFS_MK_VERSION(3, 1)
+/** the first version with statefs_io.read_many */
+#define STATEFS_READ_MANY_VERSION STATEFS_MK_VERSION(3, 2)
 
 static inline bool statefs_is_version_compatible
 (unsigned own_version, unsigned lib_ver)
@@ -314,6 +387,27 @@ static inline bool statefs_is_compatible
     return statefs_is_version_compatible(own_version, provider->version);
 }
 
+/**
+ * used by server to check if optional statefs_io.read_view is
+ * supported: io structure of the older providers is shorter
+ */
+static inline bool statefs_has_read_view(struct statefs_provider *provider)
+{
+    return statefs_is_version_compatible
+        (provider->version, STATEFS_READ_VIEW_VERSION)
+        && provider->io.read_view;
+}
+
+/**
+ * used to check if optional statefs_io.read_many is supported
+ */
+static inline bool statefs_has_read_many(struct statefs_provider *provider)
+{
+    return statefs_is_version_compatible
+        (provider->version, STATEFS_READ_MANY_VERSION)
+        && provider->io.read_many;
+}
+
 /** @}
  * provider api
  */
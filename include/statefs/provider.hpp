@@ -14,9 +14,14 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <memory>
+#include <atomic>
+#include <mutex>
 
 #include <string.h>
+#include <errno.h>
+#include <stdint.h>
 // TODO TMP
 #include <iostream>
 
@@ -190,13 +195,32 @@ public:
 };
 
 
+/**
+ * Children are stored in the vector sorted by name, so iteration
+ * handle is just an index (index + 1, 0 is not used) and iteration
+ * does not allocate anything. Names are also compiled into the flat
+ * open addressing hash table with short names stored inline, so
+ * lookup usually touches only one table cache line.
+ *
+ * Insertion only appends a child, the vector is sorted and the table
+ * is built once on the first lookup or iteration after insertion, so
+ * building a branch is O(n log n) and any branch, including the
+ * provider root, gets the table without extra calls. If several
+ * children have the same name, the first inserted one is kept.
+ *
+ * freeze() does the same eagerly for the branch and its child
+ * namespaces, so the first access from statefs does not pay for it,
+ * after that the branch is immutable: insert() throws cor::Error.
+ * Branch which is not frozen should not be changed while it can be
+ * accessed by statefs.
+ */
 class BranchStorage
 {
 public:
     typedef std::shared_ptr<ANode> child_ptr;
 
-    typedef std::map<std::string, child_ptr> storage_type;
-    typedef storage_type::const_iterator iter_type;
+    typedef std::pair<std::string, child_ptr> item_type;
+    typedef std::vector<item_type> storage_type;
 
 public:
 
@@ -211,9 +235,30 @@ public:
     void next(statefs_handle_t*) const;
     bool release(statefs_handle_t) const;
 
+    /// sort and build lookup table for the storage and child
+    /// namespaces now instead of the first access, storage can't be
+    /// changed after that
+    void freeze();
+
 private:
 
-    storage_type props_;
+    void prepare() const;
+    void build_index() const;
+
+    // 32 bytes, 2 slots per cache line
+    struct Slot
+    {
+        uint32_t hash;
+        uint32_t pos; // index + 1, 0 - empty slot
+        char name[23]; // name if it fits, otherwise full name is compared
+        uint8_t is_inline;
+    };
+
+    mutable storage_type props_;
+    mutable std::vector<Slot> index_;
+    mutable std::atomic<bool> is_ready_;
+    mutable std::mutex mutex_;
+    bool is_frozen_;
 };
 
 template <class BranchT>
@@ -239,6 +284,12 @@ public:
         return storage_.insert(child);
     }
 
+    /// optional, can be called when the tree is built, see BranchStorage
+    void freeze()
+    {
+        storage_.freeze();
+    }
+
 private:
 
     static const statefs_branch branch_template;
@@ -335,6 +386,8 @@ public:
 
     virtual int read(char *dst, statefs_size_t len, statefs_off_t off) =0;
     virtual int write(char const*, statefs_size_t, statefs_off_t) =0;
+    /// by default value is read using read()
+    virtual int read_view(::statefs_view *);
 };
 
 class AProperty : public PropertyWrapper
@@ -354,6 +407,14 @@ public:
     static AProperty const* self_cast(::statefs_property const* p);
 };
 
+/// property implementation can support statefs_io.read_view by
+/// overloading this function
+template <typename T, typename HandleT>
+int property_read_view(T &, HandleT *, ::statefs_view *)
+{
+    return -ENOTSUP;
+}
+
 template <typename T, typename HandleT>
 class BasicPropertyAccessor : public APropertyAccessor
 {
@@ -371,6 +432,11 @@ public:
         return prop_->write(handle_.get(), src, len, off);
     }
 
+    virtual int read_view(::statefs_view *view)
+    {
+        return property_read_view(*prop_, handle_.get(), view);
+    }
+
 protected:
     std::shared_ptr<T> prop_;
     std::unique_ptr<HandleT> handle_;
@@ -465,6 +531,9 @@ private:
     static void close(statefs_handle_t);
     static bool connect(::statefs_property *, ::statefs_slot *);
     static void disconnect(::statefs_property *);
+    static int read_view(statefs_handle_t, ::statefs_view *);
+    static int read_many(::statefs_namespace *
+                         , ::statefs_slice *, statefs_size_t);
 
     void init_data();
 
@@ -12,6 +12,10 @@
 #include <cor/error.hpp>
 #include <metafuse/common.hpp>
 #include <metafuse/entry.hpp>
+#include <metafuse/lowlevel.hpp>
+#include <metafuse/cache.hpp>
+#include <metafuse/rcu.hpp>
+#include <metafuse/handles.hpp>
 
 #include <list>
 #include <string>
@@ -25,6 +29,7 @@
 #include <sys/types.h>
 #include <unordered_map>
 #include <poll.h>
+#include <limits.h>
 
 namespace metafuse
 {
@@ -129,79 +134,251 @@ private:
     int value_;
 };
 
+enum child_type
+{
+    child_dir = 0,
+    child_file,
+    child_link,
+    child_types_count
+};
+
+static inline mode_t child_type_mode(child_type type)
+{
+    static const mode_t modes[] = { S_IFDIR, S_IFREG, S_IFLNK };
+    return modes[type];
+}
+
+/**
+ * Directory children index: each child is stored together with its
+ * type, so any lookup is a single hash probe. Index is read-mostly,
+ * lookups are not locking anything: each modification publishes a
+ * new immutable copy of the table (see RcuPtr), modifications are
+ * serialized. Lookup accepts Name referencing the path in place, so
+ * it does not allocate a key string.
+ */
 class Storage
 {
 public:
-    typedef std::unordered_map<std::string, entry_ptr> map_t;
-    typedef typename map_t::value_type item_type;
-    typedef typename map_t::mapped_type value_type;
+    struct Item
+    {
+        Item() : type(child_file) {}
+        Item(child_type t, entry_ptr const &e) : entry(e), type(t) {}
+
+        entry_ptr entry;
+        child_type type;
+    };
+
+    typedef std::unordered_map<std::string, Item> map_t;
+    typedef map_t::value_type item_type;
+    typedef std::unordered_map<std::string, entry_ptr> entries_type;
+
+    /// immutable version of the directory table
+    class Table
+    {
+    public:
+        Table() { counts_.fill(0); }
+
+        /// only items are copied, index is rebuilt after modification
+        Table(Table const &from) : items_(from.items_) { counts_.fill(0); }
+
+        map_t const& items() const
+        {
+            return items_;
+        }
+
+        /// items sorted by name, for stable readdir output
+        std::vector<item_type const*> const& sorted() const
+        {
+            return sorted_;
+        }
+
+        size_t count(child_type type) const
+        {
+            return counts_[type];
+        }
+
+        /// open addressing hash index, it is built by reindex()
+        item_type const* lookup(Name const &name) const
+        {
+            if (index_.empty())
+                return nullptr;
+            auto mask = index_.size() - 1;
+            for (auto pos = name.hash() & mask; index_[pos];
+                 pos = (pos + 1) & mask) {
+                if (name == index_[pos]->first)
+                    return index_[pos];
+            }
+            return nullptr;
+        }
+
+    private:
+        friend class Storage;
+
+        void reindex()
+        {
+            counts_.fill(0);
+            sorted_.clear();
+            sorted_.reserve(items_.size());
+            for (auto const &item : items_) {
+                sorted_.push_back(&item);
+                ++counts_[item.second.type];
+            }
+            std::sort(sorted_.begin(), sorted_.end()
+                      , [](item_type const *a, item_type const *b) {
+                          return a->first < b->first;
+                      });
+
+            // load factor is kept <= 0.5
+            size_t size = 8;
+            while (size < items_.size() * 2)
+                size <<= 1;
+            index_.assign(size, nullptr);
+            auto mask = size - 1;
+            for (auto const &item : items_) {
+                auto pos = Name(item.first).hash() & mask;
+                while (index_[pos])
+                    pos = (pos + 1) & mask;
+                index_[pos] = &item;
+            }
+        }
+
+        map_t items_;
+        std::vector<item_type const*> sorted_;
+        std::vector<item_type const*> index_;
+        std::array<size_t, child_types_count> counts_;
+    };
+
+    typedef std::shared_ptr<Table const> snapshot_type;
 
-    Storage() {}
+    Storage() : table_(std::make_shared<Table>()) {}
 
     virtual ~Storage() {}
 
-    template <typename Child>
-    int add(std::string const &name, std::unique_ptr<Child> child)
+    int add(std::string const &name, child_type type, entry_ptr const &entry)
     {
-        auto &entry = entries_[name];
-        entry = std::move(child);
+        modify([&](map_t &items) {
+                items[name] = Item(type, entry);
+                return true;
+            });
         return 0;
     }
 
-    value_type find(std::string const &name)
+    /// add child if there is no child with the same name
+    int create(std::string const &name, child_type type
+               , entry_ptr const &entry)
     {
-        auto e = entries_.find(name);
-        return (e != entries_.end()) ? e->second : entry_ptr(0);
+        bool is_added = modify([&](map_t &items) {
+                return items.insert
+                    (std::make_pair(name, Item(type, entry))).second;
+            });
+        return is_added ? 0 : -EEXIST;
     }
 
-    int size()
+    entry_ptr find(Name const &name) const
     {
-        return entries_.size();
+        return table_.read([&name](Table const &table) {
+                auto p = table.lookup(name);
+                return p ? p->second.entry : entry_ptr();
+            });
+    }
+
+    /// find child only if it has specified type
+    entry_ptr find(Name const &name, child_type type) const
+    {
+        return table_.read([&name, type](Table const &table) {
+                auto p = table.lookup(name);
+                return (p && p->second.type == type)
+                    ? p->second.entry : entry_ptr();
+            });
     }
 
     int rm(std::string const &name)
     {
-        return (entries_.erase(name) > 0 ? 0 : -ENOENT);
+        bool is_found = modify([&name](map_t &items) {
+                return items.erase(name) > 0;
+            });
+        return is_found ? 0 : -ENOENT;
     }
 
-    typename map_t::const_iterator begin() const
+    /// remove child only if it has specified type
+    int rm(std::string const &name, child_type type)
     {
-        return entries_.begin();
+        bool is_found = modify([&name, type](map_t &items) {
+                auto p = items.find(name);
+                if (p == items.end() || p->second.type != type)
+                    return false;
+                items.erase(p);
+                return true;
+            });
+        return is_found ? 0 : -ENOENT;
+    }
+
+    /// atomically replaces all children of the type
+    void replace(child_type type, entries_type &&entries)
+    {
+        modify([&](map_t &items) {
+                for (auto p = items.begin(); p != items.end();) {
+                    if (p->second.type == type)
+                        p = items.erase(p);
+                    else
+                        ++p;
+                }
+                for (auto &e : entries)
+                    items[e.first] = Item(type, std::move(e.second));
+                return true;
+            });
     }
 
-    typename map_t::const_iterator end() const
+    /// consistent version of the table to iterate through
+    snapshot_type snapshot() const
     {
-        return entries_.end();
+        return table_.get();
     }
 
     void clear()
     {
-        entries_.clear();
+        table_.set(std::make_shared<Table>());
+        tree_changed();
     }
 
     bool empty() const
     {
-        std::cerr << "SZ" << entries_.size() << std::endl;
-        return entries_.empty();
+        return table_.read([](Table const &table) {
+                return table.items_.empty();
+            });
     }
 
-protected:
-    map_t entries_;
+private:
+
+    /// fn(map_t&) should return true if it modified items
+    template <typename FnT>
+    bool modify(FnT fn)
+    {
+        bool is_modified = false;
+        table_.update([&fn, &is_modified](Table &table) {
+                is_modified = fn(table.items_);
+                if (is_modified)
+                    table.reindex();
+                return is_modified;
+            });
+        if (is_modified)
+            tree_changed();
+        return is_modified;
+    }
+
+    RcuPtr<Table> table_;
 };
 
-class DirFactory : public Storage
+/// creates new entry, it is added to the directory by the caller
+class EntryFactory
 {
 public:
     typedef std::function<Entry* ()> creator_type;
-    typedef Storage base_type;
 
-    DirFactory(creator_type creator) : creator_(creator) {}
+    EntryFactory(creator_type creator) : creator_(creator) {}
 
-    int create(std::string const &name, mode_t mode)
+    int create(mode_t mode, entry_ptr &res)
     {
-        if(base_type::find(name))
-            return -EEXIST;
-
         entry_ptr d(creator_());
         if(!d)
             return -EROFS;
@@ -210,43 +387,29 @@ public:
         if (chmod_err)
             return chmod_err;
 
-        base_type::entries_[name] = d;
+        res = d;
         return 0;
     }
 
-
 private:
     creator_type creator_;
 };
 
-class FileFactory : public Storage
+class DirFactory : public EntryFactory
 {
 public:
-    typedef std::function<Entry* ()> creator_type;
-    typedef Storage base_type;
+    DirFactory(creator_type creator) : EntryFactory(creator) {}
+};
 
-    FileFactory(creator_type creator) : creator_(creator) {}
+class FileFactory : public EntryFactory
+{
+public:
+    FileFactory(creator_type creator) : EntryFactory(creator) {}
 
-    int create(std::string const &name, mode_t mode, dev_t)
+    int create(mode_t mode, dev_t, entry_ptr &res)
     {
-        if(base_type::find(name))
-            return -EEXIST;
-
-        entry_ptr d(creator_());
-        if(!d)
-            return -EROFS;
-
-        int chmod_err = d->chmod(empty_path(), mode);
-        if (chmod_err)
-            return chmod_err;
-
-        base_type::entries_[name] = d;
-        return 0;
+        return EntryFactory::create(mode, res);
     }
-
-
-private:
-    creator_type creator_;
 };
 
 class FileHandle
@@ -261,14 +424,24 @@ public:
     template <typename LockT>
     void notify(LockT const &lock)
     {
-        auto l(cor::wlock(lock));
-        is_changed_ = true;
-        auto ph = poll_;
-        l.unlock();
+        auto ph = changed(lock);
         if (ph)
             fuse_notify_poll(ph.get());
     }
 
+    /// marks handle as changed, returns poll handle to be notified
+    /// (if any) by the caller. Poller provides the new poll handle
+    /// after wakeup, so the same one is not returned twice
+    template <typename LockT>
+    poll_handle_type changed(LockT const &lock)
+    {
+        auto l(cor::wlock(lock));
+        is_changed_ = true;
+        poll_handle_type ph;
+        ph.swap(poll_);
+        return ph;
+    }
+
     void poll(poll_handle_type &ph)
     {
         is_changed_ = false;
@@ -344,6 +517,7 @@ template <typename DerivedT, typename HandleT = FileHandle,
           typename LockingPolicy = cor::NoLock>
 class DefaultFile :
     public DefaultTime,
+    public CacheControl,
     public DefaultPermissions<DefaultFile<DerivedT, LockingPolicy> >,
     public LockingPolicy
 {
@@ -354,16 +528,14 @@ class DefaultFile :
 protected:
     typedef HandleT handle_type;
     typedef std::shared_ptr<handle_type> handle_ptr;
-    typedef std::unordered_map <uint64_t, handle_ptr > handles_type;
+    typedef HandlePool<handle_type> handles_type;
 
 public:
     DefaultFile(int mode) : DefaultPermissions<self_type>(mode) {}
 
     int open(struct fuse_file_info &fi)
     {
-        handle_ptr h(new handle_type());
-        fi.fh = reinterpret_cast<decltype(fi.fh)>(h.get());
-        handles_[fi.fh] = h;
+        fi.fh = handles_.insert();
         return 0;
     }
 
@@ -532,6 +704,7 @@ public:
 template <class LockingPolicy = cor::NoLock>
 class Symlink : public NotFile,
                 public DefaultTime,
+                public CacheControl,
                 public DefaultPermissions<Symlink<LockingPolicy> >,
                 public LockingPolicy
 {
@@ -585,6 +758,7 @@ class DefaultDir :
     public LockingPolicy,
     public NotFile,
     public DefaultTime,
+    public CacheControl,
     public DefaultPermissions<DefaultDir<
                                   DirFactoryT,
                                   FileFactoryT,
@@ -599,8 +773,8 @@ public:
                FileFactoryT const &file_f,
                int perm)
         : DefaultPermissions<self_type>(perm),
-          dirs(dir_f),
-          files(file_f)
+          dir_factory(dir_f),
+          file_factory(file_f)
     {}
 
     virtual ~DefaultDir()
@@ -612,36 +786,42 @@ public:
     {
         auto l(cor::wlock(*this));
         cor::error_trace_nothrow([this]() {
-                files.clear();
-                dirs.clear();
-                links.clear();
+                children.clear();
             });
     }
 
-    entry_ptr acquire(std::string const &name)
+    entry_ptr acquire(Name const &name)
     {
-        auto p = dirs.find(name);
-        if (p)
-            return p;
-
-        p = files.find(name);
-        return p ? p : links.find(name);
+        return children.find(name);
     }
 
+    /**
+     * offset is the position of the next entry to be returned
+     * (entries are sorted by name), filler returns non-zero if its
+     * buffer is full. If directory is changed between calls some
+     * entries can be skipped or returned twice, as for any other fs.
+     * Child type is returned to be used as d_type.
+     */
     int readdir(void* buf, fuse_fill_dir_t filler, off_t offset, fuse_file_info&)
     {
-        filler(buf, ".", NULL, offset);
-        filler(buf, "..", NULL, offset);
-
-        for (auto f : files)
-                filler(buf, f.first.c_str(), NULL, offset);
-
-        for (auto d : dirs)
-                filler(buf, d.first.c_str(), NULL, offset);
-
-        for(auto l : links)
-            filler(buf, l.first.c_str(), NULL, offset);
-
+        auto table = children.snapshot();
+        auto const &items = table->sorted();
+        off_t count = items.size() + 2;
+        struct stat st;
+        memset(&st, 0, sizeof(st));
+        for (off_t pos = std::max(offset, (off_t)0); pos < count; ++pos) {
+            char const *name;
+            if (pos < 2) {
+                name = pos ? ".." : ".";
+                st.st_mode = S_IFDIR;
+            } else {
+                auto item = items[pos - 2];
+                name = item->first.c_str();
+                st.st_mode = child_type_mode(item->second.type);
+            }
+            if (filler(buf, name, &st, pos + 1))
+                break;
+        }
         return 0;
     }
 
@@ -649,7 +829,9 @@ public:
     {
         memset(stbuf, 0, sizeof(stbuf[0]));
         stbuf->st_mode = type_flag | this->mode();
-        stbuf->st_nlink = dirs.size() + files.size() + 2;
+        auto table = children.snapshot();
+        stbuf->st_nlink
+            = table->count(child_dir) + table->count(child_file) + 2;
         stbuf->st_size = 0;
         return timeattr(stbuf);
     }
@@ -675,24 +857,26 @@ public:
     template <typename Child>
     int add_dir(std::string const &name, std::unique_ptr<Child> child)
     {
-        return dirs.add(name, std::move(child));
+        return children.add(name, child_dir, std::move(child));
     }
 
     template <typename Child>
     int add_file(std::string const &name, std::unique_ptr<Child> child)
     {
-        return files.add(name, std::move(child));
+        return children.add(name, child_file, std::move(child));
     }
 
     int add_symlink(std::string const &name, std::string const &target)
     {
         auto link = make_unique<Symlink<> >(target);
-        return this->links.add(name, mk_symlink_entry(std::move(link)));
+        link->cache_timeouts_set(this->cache_timeouts());
+        return children.add
+            (name, child_link, mk_symlink_entry(std::move(link)));
     }
 
     bool empty() const
     {
-        return dirs.empty() && files.empty() && links.empty();
+        return children.empty();
     }
 
 protected:
@@ -708,36 +892,40 @@ protected:
 
     int mknod_(std::string const &name, mode_t mode, dev_t type)
     {
-        return modify([&]() { return files.create(name, mode, type); });
+        return modify([&]() -> int {
+                if (children.find(name))
+                    return -EEXIST;
+                entry_ptr file;
+                int err = file_factory.create(mode, type, file);
+                return err ? err : children.create(name, child_file, file);
+            });
     }
 
     int unlink_(std::string const &name)
     {
         return modify
-            ([&]() -> int {
-                int res = files.rm(name);
-                if (res >= 0)
-                    return res;
-                res = dirs.rm(name);
-                if (res >= 0)
-                    return res;
-                return this->links.rm(name);
-            });
+            ([&]() { return children.rm(name); });
     }
 
     int mkdir_(std::string const &name, mode_t mode)
     {
-        return modify([&]() { return dirs.create(name, mode); });
+        return modify([&]() -> int {
+                if (children.find(name))
+                    return -EEXIST;
+                entry_ptr dir;
+                int err = dir_factory.create(mode, dir);
+                return err ? err : children.create(name, child_dir, dir);
+            });
     }
 
     int rmdir_(std::string const &name)
     {
-        return modify([&]() { return dirs.rm(name); });
+        return modify([&]() { return children.rm(name, child_dir); });
     }
 
-    DirFactoryT dirs;
-    FileFactoryT files;
-    Storage links;
+    DirFactoryT dir_factory;
+    FileFactoryT file_factory;
+    Storage children;
 };
 
 template <
@@ -868,18 +1056,28 @@ public:
     {
         std::vector<char const*> argv_vec(argv, argv+argc);
         if(default_options) {
-            update_uid();
-            update_gid();
             //argv_vec.push_back("-s");
             argv_vec.push_back("-o");
             argv_vec.push_back("default_permissions");
-            argv_vec.push_back("-o");
-            argv_vec.push_back(_uid.c_str());
-            argv_vec.push_back("-o");
-            argv_vec.push_back(_gid.c_str());
+            if (!lowlevel_main_) {
+                update_uid();
+                update_gid();
+                argv_vec.push_back("-o");
+                argv_vec.push_back(_uid.c_str());
+                argv_vec.push_back("-o");
+                argv_vec.push_back(_gid.c_str());
+            }
         }
+        // low-level session does not support uid/gid options,
+        // owner is set by the backend itself
+        owner_uid_ = ::getuid();
+        owner_gid_ = ::getgid();
+        KernelNotifier::instance().root_set(&root_);
         auto args = const_cast<char**>(&argv_vec[0]);
-        int rc = main_(argv_vec.size(), args, &ops, sizeof(ops), nullptr);
+        int rc = lowlevel_main_
+            ? lowlevel_main_(argv_vec.size(), args
+                             , &ll_ops, sizeof(ll_ops), nullptr)
+            : main_(argv_vec.size(), args, &ops, sizeof(ops), nullptr);
         release();
         return rc;
     }
@@ -897,6 +1095,11 @@ public:
 
     FuseFs()
         : main_(fuse_main_real)
+        , inodes_(&root_)
+        , entry_timeout_(1.0)
+        , attr_timeout_(1.0)
+        , owner_uid_(0)
+        , owner_gid_(0)
     {
         memset(&ops, 0, sizeof(ops));
         ops.getattr = FuseFs::getattr;
@@ -917,10 +1120,35 @@ public:
         ops.poll = FuseFs::poll;
         ops.readlink = FuseFs::readlink;
         ops.destroy = FuseFs::destroy;
+
+        memset(&ll_ops, 0, sizeof(ll_ops));
+        ll_ops.lookup = FuseFs::ll_lookup;
+        ll_ops.forget = FuseFs::ll_forget;
+        ll_ops.getattr = FuseFs::ll_getattr;
+        ll_ops.setattr = FuseFs::ll_setattr;
+        ll_ops.readlink = FuseFs::ll_readlink;
+        ll_ops.mknod = FuseFs::ll_mknod;
+        ll_ops.mkdir = FuseFs::ll_mkdir;
+        ll_ops.unlink = FuseFs::ll_unlink;
+        ll_ops.rmdir = FuseFs::ll_rmdir;
+        ll_ops.open = FuseFs::ll_open;
+        ll_ops.read = FuseFs::ll_read;
+        ll_ops.write = FuseFs::ll_write;
+        ll_ops.flush = FuseFs::ll_flush;
+        ll_ops.release = FuseFs::ll_release;
+        ll_ops.readdir = FuseFs::ll_readdir;
+        ll_ops.access = FuseFs::ll_access;
+        ll_ops.poll = FuseFs::ll_poll;
+        ll_ops.destroy = FuseFs::destroy;
     }
 
     std::function<int (int, char *[], const struct fuse_operations *, size_t, void *)> main_;
 
+    /// if set, inode-based low-level fuse backend is used instead
+    /// of path-based one
+    std::function<int (int, char *[], const struct fuse_lowlevel_ops *
+                       , size_t, void *)> lowlevel_main_;
+
 private:
 
     template <typename OpT, typename ... Args>
@@ -932,8 +1160,63 @@ private:
             trace() << "Op for: '" << path << "'\n";
             auto p = impl();
             if (p) {
+                Path parsed(path);
                 res = std::mem_fn(op)
-                    (p, mk_path(path), std::forward<Args>(args)...);
+                    (p, &parsed, std::forward<Args>(args)...);
+                trace() << "Op res:" << res << std::endl;
+            }
+        } catch(std::exception const &e) {
+            std::cerr << "Caught: " << e.what() << std::endl;
+            res = -ENOMEM;
+        } catch(...) {
+            std::cerr << "Caught unknown exception" << std::endl;
+            res = -ENOMEM;
+        }
+        return res;
+    }
+
+    /**
+     * resolves path to the entry, using cached result if tree was not
+     * changed since it was resolved last time. Negative results are
+     * not cached.
+     */
+    entry_ptr resolve(const char *path)
+    {
+        auto generation = tree_generation_get();
+        auto res = paths_.find(path, generation);
+        if (res)
+            return res;
+
+        Path parsed(path);
+        // root is owned by FuseFs itself
+        res = entry_ptr(entry_ptr(), &root_);
+        for (auto const &name : parsed) {
+            res = res->lookup(name);
+            if (!res)
+                return res;
+        }
+        if (!parsed.empty())
+            paths_.insert(path, res, generation);
+        return res;
+    }
+
+    /// operation on the existing node, resolved through the cache
+    template <typename ... OpArgs, typename ... Args>
+    static int invoke_entry(const char* path
+                            , int (Entry::*op)(path_ptr, OpArgs...)
+                            , Args&&... args)
+    {
+        int res = -EPERM;
+        try {
+            trace() << "-" << caller_name() << "\n";
+            trace() << "Node op for: '" << path << "'\n";
+            auto self = instance();
+            if (self) {
+                auto entry = self->resolve(path);
+                res = entry
+                    ? std::mem_fn(op)(entry.get(), empty_path()
+                                    , std::forward<Args>(args)...)
+                    : -ENOENT;
                 trace() << "Op res:" << res << std::endl;
             }
         } catch(std::exception const &e) {
@@ -968,72 +1251,72 @@ private:
 
     static int access(const char* path, int perm)
     {
-        return invoke(path, &RootT::access, perm);
+        return invoke_entry(path, &Entry::access, perm);
     }
 
     static int chmod(const char* path, mode_t perm)
     {
-        return invoke(path, &RootT::chmod, perm);
+        return invoke_entry(path, &Entry::chmod, perm);
     }
 
     static int open(const char* path, struct fuse_file_info* fi)
     {
-        return invoke(path, &RootT::open, *fi);
+        return invoke_entry(path, &Entry::open, *fi);
     }
 
     static int release(const char* path, struct fuse_file_info* fi)
     {
-        return invoke(path, &RootT::release, *fi);
+        return invoke_entry(path, &Entry::release, *fi);
     }
 
     static int flush(const char* path, struct fuse_file_info* fi)
     {
-        return invoke(path, &RootT::flush, *fi);
+        return invoke_entry(path, &Entry::flush, *fi);
     }
 
     static int truncate(const char* path, off_t offset)
     {
-        return invoke(path, &RootT::truncate, offset);
+        return invoke_entry(path, &Entry::truncate, offset);
     }
 
     static int getattr(const char* path, struct stat* stbuf)
     {
-        return invoke(path, &RootT::getattr, stbuf);
+        return invoke_entry(path, &Entry::getattr, stbuf);
     }
 
     static int read(const char* path, char* buf, size_t size,
                      off_t offset, struct fuse_file_info* fi)
     {
-        return invoke(path, &RootT::read, buf, size, offset, *fi);
+        return invoke_entry(path, &Entry::read, buf, size, offset, *fi);
     }
 
     static int write(const char* path, const char* src, size_t size,
                       off_t offset, struct fuse_file_info* fi)
     {
-        return invoke(path, &RootT::write, src, size, offset, *fi);
+        return invoke_entry(path, &Entry::write, src, size, offset, *fi);
     }
 
     static int readdir(const char *path, void *buf, fuse_fill_dir_t filler,
                        off_t offset, struct fuse_file_info *fi)
     {
-        return invoke(path, &RootT::readdir, buf, filler, offset, *fi);
+        return invoke_entry(path, &Entry::readdir, buf, filler, offset, *fi);
     }
 
     static int utime(const char *path, utimbuf *buf)
     {
-        return invoke(path, &RootT::utime, *buf);
+        return invoke_entry(path, &Entry::utime, *buf);
     }
 
 	static int poll(const char *path, struct fuse_file_info *fi,
                     struct fuse_pollhandle *ph, unsigned *reventsp)
     {
         auto h(mk_poll_handle(ph));
-        return invoke(path, &RootT::poll, *fi, h, reventsp);
+        return invoke_entry(path, &Entry::poll, *fi, h, reventsp);
     }
 
     static int readlink(const char* path, char* buf, size_t size)
     {
-        return invoke(path, &RootT::readlink, buf, size);
+        return invoke_entry(path, &Entry::readlink, buf, size);
     }
 
     static void destroy(void *p)
@@ -1041,6 +1324,302 @@ private:
         auto root = impl();
         if (root)
             root->destroy();
+        auto self = instance();
+        if (self)
+            self->inodes_.clear();
+    }
+
+    // -------------------------------------------------------------------------
+    // low-level (inode-based) backend: each entry is resolved only
+    // once on lookup, other operations are accessing entry directly
+
+    /**
+     * op should return negative error code or 0 if it replied
+     * itself
+     */
+    template <typename OpT>
+    static void ll_invoke(fuse_req_t req, OpT op)
+    {
+        int res = -EPERM;
+        try {
+            trace() << "-" << caller_name() << "\n";
+            CurrentRequest current(req);
+            auto self = instance();
+            if (self)
+                res = op(*self);
+        } catch(std::exception const &e) {
+            std::cerr << "Caught: " << e.what() << std::endl;
+            res = -ENOMEM;
+        } catch(...) {
+            std::cerr << "Caught unknown exception" << std::endl;
+            res = -ENOMEM;
+        }
+        if (res < 0)
+            fuse_reply_err(req, -res);
+    }
+
+    /// libfuse frees request after any reply, even failed one (e.g.
+    /// interrupted), so reply result is not passed to ll_invoke to
+    /// avoid replying twice
+    static int ll_replied(int)
+    {
+        return 0;
+    }
+
+    static int ll_reply_err(fuse_req_t req, int res)
+    {
+        return (res < 0) ? res : ll_replied(fuse_reply_err(req, 0));
+    }
+
+    Entry *entry(fuse_ino_t ino)
+    {
+        return inodes_.get(ino);
+    }
+
+    int ll_stat(Entry *entry, fuse_ino_t ino, struct stat *buf)
+    {
+        int res = entry->getattr(empty_path(), buf);
+        if (res >= 0) {
+            buf->st_ino = ino;
+            buf->st_uid = owner_uid_;
+            buf->st_gid = owner_gid_;
+        }
+        return res;
+    }
+
+    double attr_timeout(CacheTimeouts const &timeouts) const
+    {
+        return (timeouts.attr >= 0) ? timeouts.attr : attr_timeout_;
+    }
+
+    int ll_reply_entry(fuse_req_t req, fuse_ino_t parent, char const *name)
+    {
+        auto child = entry(parent)->lookup(name);
+        if (!child)
+            return -ENOENT;
+
+        fuse_entry_param e;
+        memset(&e, 0, sizeof(e));
+        e.ino = reinterpret_cast<fuse_ino_t>(child.get());
+        int res = ll_stat(child.get(), e.ino, &e.attr);
+        if (res < 0)
+            return res;
+
+        inodes_.ref(child);
+        auto timeouts = child->cache_timeouts();
+        e.attr_timeout = attr_timeout(timeouts);
+        e.entry_timeout = (timeouts.entry >= 0)
+            ? timeouts.entry : entry_timeout_;
+        if (fuse_reply_entry(req, &e) == -ENOENT)
+            inodes_.forget(e.ino, 1); // request was interrupted
+        return 0;
+    }
+
+    /// parent directory operations are still path-based
+    template <typename OpT, typename ... Args>
+    int ll_child_op(fuse_ino_t parent, char const *name
+                    , OpT op, Args&&... args)
+    {
+        Path path(name);
+        return std::mem_fn(op)(entry(parent), &path
+                               , std::forward<Args>(args)...);
+    }
+
+    static void ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
+    {
+        ll_invoke(req, [&](FuseFs &self) {
+                return self.ll_reply_entry(req, parent, name);
+            });
+    }
+
+    static void ll_forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup)
+    {
+        auto self = instance();
+        if (self)
+            self->inodes_.forget(ino, nlookup);
+        fuse_reply_none(req);
+    }
+
+    static void ll_getattr(fuse_req_t req, fuse_ino_t ino
+                           , struct fuse_file_info *)
+    {
+        ll_invoke(req, [&](FuseFs &self) {
+                struct stat buf;
+                auto e = self.entry(ino);
+                int res = self.ll_stat(e, ino, &buf);
+                return (res < 0)
+                    ? res : ll_replied(fuse_reply_attr
+                    (req, &buf, self.attr_timeout(e->cache_timeouts())));
+            });
+    }
+
+    static void ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr
+                           , int to_set, struct fuse_file_info *)
+    {
+        ll_invoke(req, [&](FuseFs &self) {
+                auto e = self.entry(ino);
+                int res = 0;
+                if (to_set & FUSE_SET_ATTR_MODE)
+                    res = e->chmod(empty_path(), attr->st_mode);
+                if (res >= 0 && (to_set & FUSE_SET_ATTR_SIZE))
+                    res = e->truncate(empty_path(), attr->st_size);
+                if (res >= 0 && (to_set & (FUSE_SET_ATTR_ATIME
+                                           | FUSE_SET_ATTR_MTIME))) {
+                    utimbuf tbuf = { attr->st_atime, attr->st_mtime };
+                    res = e->utime(empty_path(), tbuf);
+                }
+                if (res < 0)
+                    return res;
+
+                struct stat buf;
+                res = self.ll_stat(e, ino, &buf);
+                return (res < 0)
+                    ? res : ll_replied(fuse_reply_attr
+                    (req, &buf, self.attr_timeout(e->cache_timeouts())));
+            });
+    }
+
+    static void ll_readlink(fuse_req_t req, fuse_ino_t ino)
+    {
+        ll_invoke(req, [&](FuseFs &self) {
+                char buf[PATH_MAX + 1];
+                int res = self.entry(ino)->readlink
+                    (empty_path(), buf, sizeof(buf));
+                return (res < 0)
+                    ? res : ll_replied(fuse_reply_readlink(req, buf));
+            });
+    }
+
+    static void ll_mknod(fuse_req_t req, fuse_ino_t parent, const char *name
+                         , mode_t m, dev_t t)
+    {
+        ll_invoke(req, [&](FuseFs &self) {
+                int res = self.ll_child_op(parent, name, &Entry::mknod, m, t);
+                return (res < 0) ? res : self.ll_reply_entry(req, parent, name);
+            });
+    }
+
+    static void ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name
+                         , mode_t m)
+    {
+        ll_invoke(req, [&](FuseFs &self) {
+                int res = self.ll_child_op(parent, name, &Entry::mkdir, m);
+                return (res < 0) ? res : self.ll_reply_entry(req, parent, name);
+            });
+    }
+
+    static void ll_unlink(fuse_req_t req, fuse_ino_t parent, const char *name)
+    {
+        ll_invoke(req, [&](FuseFs &self) {
+                return ll_reply_err
+                    (req, self.ll_child_op(parent, name, &Entry::unlink));
+            });
+    }
+
+    static void ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name)
+    {
+        ll_invoke(req, [&](FuseFs &self) {
+                return ll_reply_err
+                    (req, self.ll_child_op(parent, name, &Entry::rmdir));
+            });
+    }
+
+    static void ll_open(fuse_req_t req, fuse_ino_t ino
+                        , struct fuse_file_info *fi)
+    {
+        ll_invoke(req, [&](FuseFs &self) {
+                int res = self.entry(ino)->open(empty_path(), *fi);
+                if (res < 0)
+                    return res;
+                if (fuse_reply_open(req, fi) == -ENOENT)
+                    self.entry(ino)->release(empty_path(), *fi);
+                return 0;
+            });
+    }
+
+    static void ll_read(fuse_req_t req, fuse_ino_t ino, size_t size
+                        , off_t offset, struct fuse_file_info *fi)
+    {
+        ll_invoke(req, [&](FuseFs &self) {
+                auto e = self.entry(ino);
+                ReadRef ref;
+                int res = e->read_ref(empty_path(), size, offset, *fi, ref);
+                if (res >= 0)
+                    return ll_replied(fuse_reply_buf(req, ref.data, res));
+                if (res != -ENOTSUP)
+                    return res;
+
+                char small[4096];
+                std::vector<char> big;
+                char *buf = small;
+                if (size > sizeof(small)) {
+                    big.resize(size);
+                    buf = &big[0];
+                }
+                res = e->read(empty_path(), buf, size, offset, *fi);
+                return (res < 0)
+                    ? res : ll_replied(fuse_reply_buf(req, buf, res));
+            });
+    }
+
+    static void ll_write(fuse_req_t req, fuse_ino_t ino, const char *src
+                         , size_t size, off_t offset
+                         , struct fuse_file_info *fi)
+    {
+        ll_invoke(req, [&](FuseFs &self) {
+                int res = self.entry(ino)->write
+                    (empty_path(), src, size, offset, *fi);
+                return (res < 0) ? res : ll_replied(fuse_reply_write(req, res));
+            });
+    }
+
+    static void ll_flush(fuse_req_t req, fuse_ino_t ino
+                         , struct fuse_file_info *fi)
+    {
+        ll_invoke(req, [&](FuseFs &self) {
+                return ll_reply_err
+                    (req, self.entry(ino)->flush(empty_path(), *fi));
+            });
+    }
+
+    static void ll_release(fuse_req_t req, fuse_ino_t ino
+                           , struct fuse_file_info *fi)
+    {
+        ll_invoke(req, [&](FuseFs &self) {
+                return ll_reply_err
+                    (req, self.entry(ino)->release(empty_path(), *fi));
+            });
+    }
+
+    static void ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size
+                           , off_t offset, struct fuse_file_info *fi)
+    {
+        ll_invoke(req, [&](FuseFs &self) {
+                DirBuffer buf(req, size);
+                int res = self.entry(ino)->readdir
+                    (empty_path(), &buf, &DirBuffer::filler, offset, *fi);
+                return (res < 0) ? res : ll_replied(buf.reply(offset));
+            });
+    }
+
+    static void ll_access(fuse_req_t req, fuse_ino_t ino, int perm)
+    {
+        ll_invoke(req, [&](FuseFs &self) {
+                return ll_reply_err
+                    (req, self.entry(ino)->access(empty_path(), perm));
+            });
+    }
+
+    static void ll_poll(fuse_req_t req, fuse_ino_t ino
+                        , struct fuse_file_info *fi, struct fuse_pollhandle *ph)
+    {
+        auto h(mk_poll_handle(ph));
+        ll_invoke(req, [&](FuseFs &self) {
+                unsigned revents = 0;
+                int res = self.entry(ino)->poll(empty_path(), *fi, h, &revents);
+                return (res < 0)
+                    ? res : ll_replied(fuse_reply_poll(req, revents));
+            });
     }
 
     void update_uid() {
@@ -1058,7 +1637,14 @@ private:
     }
 
     RootT root_;
+    PathCache paths_;
     fuse_operations ops;
+    fuse_lowlevel_ops ll_ops;
+    InodeTable inodes_;
+    double entry_timeout_;
+    double attr_timeout_;
+    uid_t owner_uid_;
+    gid_t owner_gid_;
     std::string _uid;
     std::string _gid;
 };
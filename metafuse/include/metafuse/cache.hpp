@@ -0,0 +1,101 @@
+#ifndef _METAFUSE_CACHE_HPP_
+#define _METAFUSE_CACHE_HPP_
+/**
+ * @file cache.hpp
+ * @brief Part of overcomplicated fuse C++ library: cache of resolved
+ * paths
+ *
+ * @author (C) 2012, 2013 Jolla Ltd. Denis Zalevskiy <denis.zalevskiy@jollamobile.com>
+ * @copyright LGPL 2.1 http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <metafuse/entry.hpp>
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace metafuse
+{
+
+/**
+ * Maps full path to the entry it was resolved to. Each result is
+ * tagged with the tree generation it was resolved in and it is
+ * ignored if tree was changed after. Map is split into shards to
+ * avoid contention between fuse threads. Entries are not owned by
+ * cache, so removed entries are not kept alive.
+ */
+class PathCache
+{
+public:
+    entry_ptr find(char const *path, unsigned long generation)
+    {
+        auto h = hash(path);
+        auto &shard = shard_get(h);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto p = shard.items.find(h);
+        if (p == shard.items.end())
+            return entry_ptr();
+
+        auto const &item = p->second;
+        if (item.generation != generation || item.path.compare(path))
+            return entry_ptr();
+
+        return item.entry.lock();
+    }
+
+    void insert(char const *path, entry_ptr const &entry
+                , unsigned long generation)
+    {
+        auto h = hash(path);
+        auto &shard = shard_get(h);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto &item = shard.items[h];
+        // hash collision or outdated item: it is just replaced
+        item.path.assign(path);
+        item.entry = entry;
+        item.generation = generation;
+    }
+
+private:
+
+    static const size_t shards_count = 32;
+
+    struct Item
+    {
+        Item() : generation(0) {}
+
+        std::string path;
+        std::weak_ptr<Entry> entry;
+        unsigned long generation;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<size_t, Item> items;
+    };
+
+    /// FNV-1a
+    static size_t hash(char const *s)
+    {
+        size_t res = 2166136261U;
+        for (; *s; ++s) {
+            res ^= (unsigned char)*s;
+            res *= 16777619U;
+        }
+        return res;
+    }
+
+    Shard& shard_get(size_t h)
+    {
+        return shards_[h % shards_count];
+    }
+
+    std::array<Shard, shards_count> shards_;
+};
+
+} // metafuse
+
+#endif // _METAFUSE_CACHE_HPP_
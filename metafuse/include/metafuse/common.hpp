@@ -10,12 +10,17 @@
 
 #include <cor/mt.hpp>
 
-#include <list>
+#include <array>
+#include <atomic>
+#include <vector>
 #include <string>
 #include <algorithm>
-#include <sstream>
+#include <ostream>
 #include <memory>
 
+#include <string.h>
+#include <stdint.h>
+
 #include <fuse.h>
 
 namespace metafuse
@@ -23,62 +28,202 @@ namespace metafuse
 
 typedef std::shared_ptr<fuse_pollhandle> poll_handle_type;
 
+/**
+ * fs tree generation: it is changed each time any directory content
+ * is changed, so anything derived from the tree structure and tagged
+ * with the generation (e.g. cached path resolution results) is valid
+ * only while generation is the same
+ */
+inline std::atomic<unsigned long>& tree_generation()
+{
+    static std::atomic<unsigned long> generation(0);
+    return generation;
+}
+
+static inline unsigned long tree_generation_get()
+{
+    return tree_generation().load(std::memory_order_acquire);
+}
+
+static inline void tree_changed()
+{
+    tree_generation().fetch_add(1, std::memory_order_acq_rel);
+}
+
 static inline poll_handle_type mk_poll_handle(fuse_pollhandle *from)
 {
     return poll_handle_type(from, fuse_pollhandle_destroy);
 }
 
-class Path : public std::list<std::string>
+/// path element: refers to the part of the source path string
+class Name
 {
 public:
-    typedef std::list<std::string> elements_type;
+    Name() : data_(nullptr), size_(0) {}
+    Name(char const *data, size_t size) : data_(data), size_(size) {}
+    /// referenced string should outlive the name
+    Name(std::string const &from) : data_(from.data()), size_(from.size()) {}
+    Name(char const *from) : data_(from), size_(from ? strlen(from) : 0) {}
+
+    char const* data() const
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return !size_;
+    }
+
+    std::string str() const
+    {
+        return std::string(data_, size_);
+    }
 
-    Path() {}
+    bool operator == (std::string const &other) const
+    {
+        return other.size() == size_ && !memcmp(other.data(), data_, size_);
+    }
+
+    /// FNV-1a
+    size_t hash() const
+    {
+        uint32_t res = 2166136261u;
+        for (size_t i = 0; i < size_; ++i) {
+            res ^= (unsigned char)data_[i];
+            res *= 16777619u;
+        }
+        return res;
+    }
 
-    Path(std::initializer_list<std::string> src) : elements_type(src) {}
+private:
+    char const *data_;
+    size_t size_;
+};
+
+/**
+ * Path split into names. Names are referencing source path string
+ * in place, so source should outlive the path. Usual fs path depth
+ * fits into the inline storage, so path is parsed w/o heap
+ * allocations. It is consumed from the beginning by operations
+ * traversing fs tree (see next())
+ */
+class Path
+{
+    static const size_t inline_depth = 8;
+public:
+    typedef Name value_type;
+    typedef Name const* const_iterator;
+
+    Path() : names_(&inline_[0]), pos_(0), size_(0) {}
 
     Path(char const *path_str)
+        : names_(&inline_[0]), pos_(0), size_(0)
     {
         if (!path_str)
             return;
-        std::istringstream ps(path_str + sizeof('/'));
-        char token[256];
-        while (ps.getline(token, 256 ,'/'))
-            push_back(token);
+
+        char const *p = path_str;
+        while (*p) {
+            while (*p == '/')
+                ++p;
+            char const *begin = p;
+            while (*p && *p != '/')
+                ++p;
+            if (p != begin)
+                push_back(Name(begin, p - begin));
+        }
     }
 
-    Path(elements_type::const_iterator begin,
-         elements_type::const_iterator end)
+    ~Path()
     {
-        std::copy(begin, end, std::back_inserter(*this));
     }
 
-    ~Path()
+    bool empty() const
     {
+        return pos_ == size_;
+    }
+
+    /// number of names left
+    size_t size() const
+    {
+        return size_ - pos_;
     }
 
     bool is_top() const
     {
-        return (++begin() == end());
+        return size() == 1;
+    }
+
+    Name const& front() const
+    {
+        return names_[pos_];
+    }
+
+    /// skip current front name
+    void next()
+    {
+        if (pos_ < size_)
+            ++pos_;
+    }
+
+    const_iterator begin() const
+    {
+        return &names_[pos_];
+    }
+
+    const_iterator end() const
+    {
+        return &names_[size_];
     }
 
 private:
 
     Path(Path &);
     Path & operator = (Path &);
-};
 
+    void push_back(Name const &name)
+    {
+        if (size_ == inline_depth) {
+            // too deep, switching to heap
+            deep_.reserve(inline_depth * 2);
+            deep_.assign(inline_.begin(), inline_.end());
+        }
+        if (size_ >= inline_depth) {
+            deep_.push_back(name);
+            names_ = &deep_[0];
+        } else {
+            inline_[size_] = name;
+        }
+        ++size_;
+    }
+
+    std::array<Name, inline_depth> inline_;
+    std::vector<Name> deep_;
+    Name *names_;
+    size_t pos_;
+    size_t size_;
+};
 
-typedef std::unique_ptr<Path> path_ptr;
+/// not owning pointer, path is allocated on the stack by the caller
+typedef Path* path_ptr;
 
-path_ptr empty_path()
+static inline path_ptr empty_path()
 {
-    return path_ptr((Path*)0);
+    return nullptr;
 }
 
-path_ptr mk_path(char const *path)
+template<typename T>
+std::basic_ostream<T>& operator <<
+(std::basic_ostream<T> &dst, Name const &src)
 {
-    return path_ptr(new Path(path));
+    dst.write(src.data(), src.size());
+    return dst;
 }
 
 template<typename T>
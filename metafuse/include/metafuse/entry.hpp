@@ -9,14 +9,13 @@
  */
 
 #include <metafuse/common.hpp>
+#include <metafuse/notify.hpp>
 #include <cor/trace.hpp>
 // TMP for make_unique
 #include <statefs/util.hpp>
 
 #include <fuse.h>
-#include <list>
 #include <string>
-#include <sstream>
 #include <memory>
 #include <vector>
 #include <string.h>
@@ -29,6 +28,89 @@
 namespace metafuse
 {
 
+class Entry;
+typedef std::shared_ptr<Entry> entry_ptr;
+
+/**
+ * How long (seconds) kernel can cache entry name lookup and its
+ * attributes. Negative value means fs default timeout is used. Used
+ * only by the low-level (inode-based) backend, high-level fuse has
+ * only global timeouts (entry_timeout and attr_timeout options).
+ */
+struct CacheTimeouts
+{
+    CacheTimeouts(double e = -1, double a = -1) : entry(e), attr(a) {}
+
+    double entry;
+    double attr;
+};
+
+/**
+ * Data read reply is referencing w/o copying it into the read
+ * buffer, data is valid while holder is referenced
+ */
+struct ReadRef
+{
+    ReadRef() : data(nullptr) {}
+
+    char const *data;
+    std::shared_ptr<void const> holder;
+};
+
+/**
+ * Mixin for entry implementations: per-node cache policy and kernel
+ * cache invalidation
+ */
+class CacheControl
+{
+public:
+    CacheControl() : node_(nullptr) {}
+    virtual ~CacheControl() {}
+
+    virtual CacheTimeouts cache_timeouts() const
+    {
+        return timeouts_;
+    }
+
+    void cache_timeouts_set(CacheTimeouts const &timeouts)
+    {
+        timeouts_ = timeouts;
+    }
+
+    /// set by entry containing this implementation
+    void cache_node_set(void const *node)
+    {
+        node_ = node;
+    }
+
+    /// see KernelNotifier::inval_inode()
+    int cache_invalidate(off_t off, off_t len) const
+    {
+        return KernelNotifier::instance().inval_inode(node_, off, len);
+    }
+
+private:
+    CacheTimeouts timeouts_;
+    void const *node_;
+};
+
+static inline CacheTimeouts cache_timeouts_get(CacheControl const *impl)
+{
+    return impl->cache_timeouts();
+}
+
+static inline CacheTimeouts cache_timeouts_get(void const *)
+{
+    return CacheTimeouts();
+}
+
+static inline void cache_node_set(CacheControl *impl, void const *node)
+{
+    impl->cache_node_set(node);
+}
+
+static inline void cache_node_set(void *, void const *) {}
+
 class Entry
 {
 public:
@@ -101,6 +183,18 @@ public:
         return -ENOENT;
     }
 
+    /**
+     * read data w/o copying it, used by the inode-based backend
+     *
+     * @return data length or negative error code, -ENOTSUP means
+     * read() should be used
+     */
+    virtual int read_ref(path_ptr path, size_t size, off_t offset,
+                         struct fuse_file_info &fi, ReadRef &dst)
+    {
+        return -ENOTSUP;
+    }
+
     virtual int readdir(path_ptr path, void *buf, fuse_fill_dir_t filler,
                         off_t offset, struct fuse_file_info &fi)
     {
@@ -123,9 +217,18 @@ public:
     {
         return -ENOTSUP;
     }
-};
 
-typedef std::shared_ptr<Entry> entry_ptr;
+    /// resolve direct child by name, used by inode-based backend
+    virtual entry_ptr lookup(Name const &name)
+    {
+        return entry_ptr();
+    }
+
+    virtual CacheTimeouts cache_timeouts() const
+    {
+        return CacheTimeouts();
+    }
+};
 
 
 template <typename ImplT>
@@ -137,8 +240,20 @@ public:
     typedef ImplT impl_type;
     typedef std::shared_ptr<ImplT> impl_ptr;
 
-    FileEntry(std::unique_ptr<impl_type> impl) : impl_(std::move(impl)) {}
-    FileEntry(impl_ptr impl) : impl_(impl) {}
+    FileEntry(std::unique_ptr<impl_type> impl) : impl_(std::move(impl))
+    {
+        cache_node_set(impl_.get(), this);
+    }
+
+    FileEntry(impl_ptr impl) : impl_(impl)
+    {
+        cache_node_set(impl_.get(), this);
+    }
+
+    virtual CacheTimeouts cache_timeouts() const
+    {
+        return cache_timeouts_get(impl_.get());
+    }
 
     virtual int open(path_ptr path, struct fuse_file_info &fi)
     {
@@ -234,7 +349,15 @@ public:
     typedef ImplT impl_type;
     typedef std::shared_ptr<ImplT> impl_ptr;
 
-    SymlinkEntry(std::unique_ptr<ImplT> impl) : impl_(std::move(impl)) {}
+    SymlinkEntry(std::unique_ptr<ImplT> impl) : impl_(std::move(impl))
+    {
+        cache_node_set(impl_.get(), this);
+    }
+
+    virtual CacheTimeouts cache_timeouts() const
+    {
+        return cache_timeouts_get(impl_.get());
+    }
 
     virtual int getattr(path_ptr path, struct stat *buf)
     {
@@ -300,8 +423,20 @@ public:
     typedef ImplT impl_type;
     typedef std::shared_ptr<ImplT> impl_ptr;
 
-    DirEntry(std::unique_ptr<impl_type> impl) : impl_(std::move(impl)) {}
-    DirEntry(impl_ptr impl) : impl_(impl) {}
+    DirEntry(std::unique_ptr<impl_type> impl) : impl_(std::move(impl))
+    {
+        cache_node_set(impl_.get(), this);
+    }
+
+    DirEntry(impl_ptr impl) : impl_(impl)
+    {
+        cache_node_set(impl_.get(), this);
+    }
+
+    virtual CacheTimeouts cache_timeouts() const
+    {
+        return cache_timeouts_get(impl_.get());
+    }
 
     virtual int unlink(path_ptr path)
     {
@@ -417,6 +552,11 @@ public:
              std::move(path), buf, size);
     }
 
+    virtual entry_ptr lookup(Name const &name)
+    {
+        return find(name);
+    }
+
 protected:
 
     friend impl_ptr dir_entry_impl<ImplT>(entry_ptr);
@@ -434,17 +574,17 @@ protected:
     int dir_op(LockT lock, ImplOpT impl_op, ChildOpT child_op,
                path_ptr path, Args&&... args)
     {
-        trace() << "dir op:" << *path << std::endl;
-        if (path->empty())
+        if (!path || path->empty())
             return -EINVAL;
+        trace() << "dir op:" << *path << std::endl;
 
         if (path->is_top()) {
             auto l(lock(*impl_));
-            return std::mem_fn(impl_op)(impl_.get(), path->front()
+            return std::mem_fn(impl_op)(impl_.get(), path->front().str()
                                         , std::forward<Args>(args)...);
         }
-        return call_child<LockT>(lock, std::move(path), child_op
-                                 , std::forward<Args>(args)...);
+        return call_child(std::move(path), child_op
+                          , std::forward<Args>(args)...);
     }
 
     template <typename LockT,
@@ -454,37 +594,36 @@ protected:
     int node_op(LockT lock, ImplOpT impl_op, ChildOpT child_op,
                 path_ptr path, Args&&... args)
     {
-        trace() << "node op:" << *path << std::endl;
-        if (path->empty()) {
+        // entry can be accessed directly (w/o path) by inode
+        if (!path || path->empty()) {
             auto l(lock(*impl_));
             return std::mem_fn(impl_op)
                 (impl_.get(), std::forward<Args>(args)...);
         }
 
-        return call_child<LockT>(lock, std::move(path), child_op
-                                 , std::forward<Args>(args)...);
+        trace() << "node op:" << *path << std::endl;
+        return call_child(std::move(path), child_op
+                          , std::forward<Args>(args)...);
     }
 
-    template <typename LockT>
-    entry_ptr find(LockT lock, std::string const &name)
+    /// directory lock is not taken: acquire() should be thread-safe
+    /// itself, default directory storage is lock-free for readers
+    entry_ptr find(Name const &name)
     {
-        auto l(lock(*impl_));
         return impl_->acquire(name);
     }
 
-    template <typename LockT,
-        typename OpT,
-        typename ... Args>
-    int call_child(LockT lock, path_ptr path, OpT op, Args&&... args)
+    template <typename OpT, typename ... Args>
+    int call_child(path_ptr path, OpT op, Args&&... args)
     {
         trace() << "for child: " << path->front() << std::endl;
-        auto entry = find(lock, path->front());
+        auto entry = find(path->front());
         if (!entry) {
             trace() << "no child " << path->front() << std::endl;
             return -ENOENT;
         }
-        path->pop_front();
-        
+        path->next();
+
         return std::mem_fn(op)
             (entry.get(), std::move(path), std::forward<Args>(args)...);
     }
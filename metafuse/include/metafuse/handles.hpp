@@ -0,0 +1,160 @@
+#ifndef _METAFUSE_HANDLES_HPP_
+#define _METAFUSE_HANDLES_HPP_
+/**
+ * @file handles.hpp
+ * @brief Part of overcomplicated fuse C++ library: open file handles
+ * storage
+ *
+ * @author (C) 2012, 2013 Jolla Ltd. Denis Zalevskiy <denis.zalevskiy@jollamobile.com>
+ * @copyright LGPL 2.1 http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+namespace metafuse
+{
+
+/**
+ * Pool of open file handles. Released slots and handle objects are
+ * reused, so open/release is O(1) and does not allocate after pool
+ * is grown to the maximum number of simultaneously opened handles.
+ *
+ * Fuse file handle (fi.fh) is (generation << 32 | (slot index + 1)),
+ * generation is incremented each time slot is released, so stale
+ * handle values are not resolved to the handle reusing the slot.
+ *
+ * Pool is not thread-safe, it is protected by the file lock.
+ */
+template <typename HandleT>
+class HandlePool
+{
+public:
+    typedef std::shared_ptr<HandleT> handle_ptr;
+
+    HandlePool() : used_(none), free_(none), size_(0) {}
+
+    HandlePool(HandlePool const&) = delete;
+    HandlePool& operator = (HandlePool const&) = delete;
+
+    /// @return fuse file handle value
+    uint64_t insert()
+    {
+        uint32_t pos;
+        if (free_ != none) {
+            pos = free_;
+            free_ = slots_[pos].next;
+        } else {
+            pos = slots_.size();
+            slots_.push_back(Slot());
+        }
+        auto &slot = slots_[pos];
+        if (!slot.handle)
+            slot.handle = std::make_shared<HandleT>();
+
+        slot.is_used = true;
+        slot.prev = none;
+        slot.next = used_;
+        if (used_ != none)
+            slots_[used_].prev = pos;
+        used_ = pos;
+        ++size_;
+        return ((uint64_t)slot.generation << 32) | (pos + 1);
+    }
+
+    bool erase(uint64_t fh)
+    {
+        auto pos = position(fh);
+        if (pos == none)
+            return false;
+
+        auto &slot = slots_[pos];
+        if (slot.prev != none)
+            slots_[slot.prev].next = slot.next;
+        else
+            used_ = slot.next;
+        if (slot.next != none)
+            slots_[slot.next].prev = slot.prev;
+
+        // handle can still be referenced by someone else, in this
+        // case it is not reused
+        if (slot.handle.unique())
+            *slot.handle = HandleT();
+        else
+            slot.handle.reset();
+
+        slot.is_used = false;
+        ++slot.generation;
+        slot.next = free_;
+        free_ = pos;
+        --size_;
+        return true;
+    }
+
+    HandleT* get(uint64_t fh) const
+    {
+        auto pos = position(fh);
+        return (pos != none) ? slots_[pos].handle.get() : nullptr;
+    }
+
+    /// to be used if handle is accessed w/o holding the pool lock
+    handle_ptr acquire(uint64_t fh) const
+    {
+        auto pos = position(fh);
+        return (pos != none) ? slots_[pos].handle : handle_ptr();
+    }
+
+    /// fn(handle_ptr const&) is called for each open handle
+    template <typename FnT>
+    void for_each(FnT fn) const
+    {
+        for (auto pos = used_; pos != none; pos = slots_[pos].next)
+            fn(slots_[pos].handle);
+    }
+
+    bool empty() const
+    {
+        return !size_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+private:
+
+    static const uint32_t none = (uint32_t)-1;
+
+    struct Slot
+    {
+        Slot() : generation(0), prev(none), next(none), is_used(false) {}
+
+        handle_ptr handle;
+        uint32_t generation;
+        uint32_t prev;
+        uint32_t next;
+        bool is_used;
+    };
+
+    uint32_t position(uint64_t fh) const
+    {
+        uint32_t pos = (uint32_t)fh - 1;
+        if (pos >= slots_.size())
+            return none;
+
+        auto const &slot = slots_[pos];
+        return (slot.is_used && slot.generation == (uint32_t)(fh >> 32))
+            ? pos : none;
+    }
+
+    std::vector<Slot> slots_;
+    uint32_t used_;
+    uint32_t free_;
+    size_t size_;
+};
+
+} // metafuse
+
+#endif // _METAFUSE_HANDLES_HPP_
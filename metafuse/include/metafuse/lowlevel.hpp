@@ -0,0 +1,223 @@
+#ifndef _METAFUSE_LOWLEVEL_HPP_
+#define _METAFUSE_LOWLEVEL_HPP_
+/**
+ * @file lowlevel.hpp
+ * @brief Part of overcomplicated fuse C++ library: support for
+ * inode-based (low-level) fuse API
+ *
+ * @author (C) 2012, 2013 Jolla Ltd. Denis Zalevskiy <denis.zalevskiy@jollamobile.com>
+ * @copyright LGPL 2.1 http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <metafuse/entry.hpp>
+
+#include <fuse_lowlevel.h>
+
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+
+#include <errno.h>
+#include <signal.h>
+
+namespace metafuse
+{
+
+/**
+ * Maps low-level fuse inode numbers to entries. Inode number is the
+ * entry address, so resolving inode does not need any lookup. Entry
+ * is kept alive while kernel holds lookup references to it (until
+ * forget() is called) even if it is already removed from the parent
+ * directory.
+ */
+class InodeTable
+{
+public:
+    InodeTable(Entry *root) : root_(root) {}
+
+    InodeTable(InodeTable const&) = delete;
+    InodeTable& operator = (InodeTable const&) = delete;
+
+    Entry *get(fuse_ino_t ino) const
+    {
+        return (ino == FUSE_ROOT_ID) ? root_ : reinterpret_cast<Entry*>(ino);
+    }
+
+    /// register one more kernel lookup reference to the entry
+    fuse_ino_t ref(entry_ptr const &entry)
+    {
+        auto ino = reinterpret_cast<fuse_ino_t>(entry.get());
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &node = nodes_[ino];
+        if (!node.nlookup)
+            node.entry = entry;
+        ++node.nlookup;
+        return ino;
+    }
+
+    void forget(fuse_ino_t ino, unsigned long nlookup)
+    {
+        if (ino == FUSE_ROOT_ID)
+            return;
+
+        entry_ptr released;
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto p = nodes_.find(ino);
+        if (p == nodes_.end())
+            return;
+
+        auto &node = p->second;
+        if (node.nlookup > nlookup) {
+            node.nlookup -= nlookup;
+            return;
+        }
+        // entry can be destroyed here, do it w/o lock held
+        released = std::move(node.entry);
+        nodes_.erase(p);
+        lock.unlock();
+    }
+
+    void clear()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        nodes_type nodes;
+        std::swap(nodes, nodes_);
+        lock.unlock();
+    }
+
+private:
+
+    struct Node
+    {
+        Node() : nlookup(0) {}
+
+        entry_ptr entry;
+        unsigned long nlookup;
+    };
+
+    typedef std::unordered_map<fuse_ino_t, Node> nodes_type;
+
+    Entry *root_;
+    std::mutex mutex_;
+    nodes_type nodes_;
+};
+
+/// inode is unknown for entries returned by readdir w/o lookup
+static const fuse_ino_t unknown_ino = 0xffffffff;
+
+/**
+ * Accumulates readdir entries in the low-level fuse format, filler()
+ * has the same signature as high-level fuse_fill_dir_t so it can be
+ * passed to the existing readdir implementations. If readdir passes
+ * non-zero offsets to the filler, entries are streamed: buffer is
+ * limited by the requested size and filler returns 1 when it is
+ * full. Otherwise the whole listing is accumulated and requested
+ * slice is returned.
+ */
+class DirBuffer
+{
+public:
+    DirBuffer(fuse_req_t req, size_t size)
+        : req_(req), size_(size), is_streaming_(false)
+    {}
+
+    static int filler(void *self, const char *name,
+                      const struct stat *stbuf, off_t off)
+    {
+        return static_cast<DirBuffer*>(self)->add(name, stbuf, off);
+    }
+
+    /// off is the offset requested by the kernel
+    int reply(off_t off) const
+    {
+        if (is_streaming_)
+            off = 0;
+
+        if (off < 0 || (size_t)off >= data_.size())
+            return fuse_reply_buf(req_, NULL, 0);
+
+        return fuse_reply_buf(req_, &data_[off]
+                              , std::min(data_.size() - off, size_));
+    }
+
+private:
+
+    int add(const char *name, const struct stat *stbuf, off_t off)
+    {
+        struct stat st;
+        memset(&st, 0, sizeof(st));
+        if (stbuf)
+            st = *stbuf;
+        if (!st.st_ino)
+            st.st_ino = unknown_ino;
+
+        auto pos = data_.size();
+        auto len = fuse_add_direntry(req_, NULL, 0, name, NULL, 0);
+        if (off) {
+            is_streaming_ = true;
+            if (pos + len > size_)
+                return 1;
+        }
+        data_.resize(pos + len);
+        fuse_add_direntry(req_, &data_[pos], len, name, &st
+                          , off ? off : data_.size());
+        return 0;
+    }
+
+    fuse_req_t req_;
+    size_t size_;
+    bool is_streaming_;
+    std::vector<char> data_;
+};
+
+/**
+ * Low-level request processed by the current thread, it is set for
+ * the operation duration, so blocking operation can check if request
+ * is interrupted
+ */
+class CurrentRequest
+{
+public:
+    CurrentRequest(fuse_req_t req) : prev_(get())
+    {
+        get() = req;
+    }
+
+    ~CurrentRequest()
+    {
+        get() = prev_;
+    }
+
+    static fuse_req_t& get()
+    {
+        static __thread fuse_req_t req = nullptr;
+        return req;
+    }
+
+private:
+    CurrentRequest(CurrentRequest const&);
+    CurrentRequest& operator = (CurrentRequest const&);
+
+    fuse_req_t prev_;
+};
+
+/**
+ * is request processed by the current thread interrupted. High-level
+ * fuse tracks interrupts only if it is mounted with -o intr, so the
+ * request is also treated as interrupted if the requesting process is
+ * gone (e.g. killed by the signal)
+ */
+static inline bool is_interrupted()
+{
+    auto req = CurrentRequest::get();
+    if (req)
+        return fuse_req_interrupted(req);
+    if (fuse_interrupted())
+        return true;
+    auto ctx = fuse_get_context();
+    return ctx && ctx->pid > 0 && ::kill(ctx->pid, 0) < 0 && errno == ESRCH;
+}
+
+} // metafuse
+
+#endif // _METAFUSE_LOWLEVEL_HPP_
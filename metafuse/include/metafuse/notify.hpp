@@ -0,0 +1,91 @@
+#ifndef _METAFUSE_NOTIFY_HPP_
+#define _METAFUSE_NOTIFY_HPP_
+/**
+ * @file notify.hpp
+ * @brief Part of overcomplicated fuse C++ library: notifications
+ * sent by fs to the kernel
+ *
+ * @author (C) 2012, 2013 Jolla Ltd. Denis Zalevskiy <denis.zalevskiy@jollamobile.com>
+ * @copyright LGPL 2.1 http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <fuse_lowlevel.h>
+
+#include <mutex>
+#include <errno.h>
+
+namespace metafuse
+{
+
+/**
+ * Sends cache invalidation requests to the kernel. It works only
+ * while low-level fuse session is attached, otherwise requests are
+ * ignored. Nodes are identified by the entry address (it is used as
+ * an inode number by the low-level backend).
+ */
+class KernelNotifier
+{
+public:
+
+    static KernelNotifier& instance()
+    {
+        static KernelNotifier self;
+        return self;
+    }
+
+    /// root entry has the fixed inode number
+    void root_set(void const *root)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        root_ = root;
+    }
+
+    void attach(fuse_chan *ch)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ch_ = ch;
+    }
+
+    void detach()
+    {
+        attach(nullptr);
+    }
+
+    /// if not attached kernel caches can't be invalidated by fs
+    bool is_attached()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return ch_ != nullptr;
+    }
+
+    /**
+     * invalidate cached node data in the range [off, off + len),
+     * len == 0 means up to the end of file. If off is negative only
+     * attributes are invalidated.
+     *
+     * Should not be called from the fuse request handler for the
+     * same node.
+     */
+    int inval_inode(void const *node, off_t off, off_t len)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ch_ || !node)
+            return -ENOTCONN;
+
+        auto ino = (node == root_)
+            ? FUSE_ROOT_ID : reinterpret_cast<fuse_ino_t>(node);
+        return fuse_lowlevel_notify_inval_inode(ch_, ino, off, len);
+    }
+
+private:
+
+    KernelNotifier() : root_(nullptr), ch_(nullptr) {}
+
+    std::mutex mutex_;
+    void const *root_;
+    fuse_chan *ch_;
+};
+
+} // metafuse
+
+#endif // _METAFUSE_NOTIFY_HPP_
@@ -0,0 +1,174 @@
+#ifndef _METAFUSE_RCU_HPP_
+#define _METAFUSE_RCU_HPP_
+/**
+ * @file rcu.hpp
+ * @brief Part of overcomplicated fuse C++ library: read-copy-update
+ * support for read-mostly data
+ *
+ * @author (C) 2012, 2013 Jolla Ltd. Denis Zalevskiy <denis.zalevskiy@jollamobile.com>
+ * @copyright LGPL 2.1 http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+
+namespace metafuse
+{
+
+/**
+ * Epoch-based grace period tracking. Readers are only incrementing
+ * and decrementing counter of the current epoch (counters are spread
+ * between slots selected by thread id to avoid sharing the same cache
+ * line), writer waits until all readers entered before the epoch
+ * switch are gone.
+ *
+ * Read sections should be short and should not call synchronize()
+ * itself.
+ */
+class Rcu
+{
+public:
+
+    static Rcu& instance()
+    {
+        static Rcu self;
+        return self;
+    }
+
+    class ReadSection
+    {
+    public:
+        ReadSection() : counter_(Rcu::instance().enter()) {}
+        ~ReadSection() { counter_->fetch_sub(1, std::memory_order_release); }
+
+        ReadSection(ReadSection const&) = delete;
+        ReadSection& operator = (ReadSection const&) = delete;
+    private:
+        std::atomic<long> *counter_;
+    };
+
+    /// wait for all readers which can access replaced data
+    void synchronize()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto parity = epoch_.fetch_add(1) & 1;
+        for (auto &slot : slots_[parity])
+            while (slot.readers.load())
+                std::this_thread::yield();
+    }
+
+private:
+
+    Rcu() : epoch_(0)
+    {
+        for (auto &slots : slots_)
+            for (auto &slot : slots)
+                slot.readers.store(0);
+    }
+
+    std::atomic<long>* enter()
+    {
+        auto pos = std::hash<std::thread::id>()(std::this_thread::get_id())
+            % slots_count;
+        while (true) {
+            auto epoch = epoch_.load();
+            auto &counter = slots_[epoch & 1][pos].readers;
+            counter.fetch_add(1);
+            // epoch was switched meanwhile, writer can miss this
+            // reader, so retry with the new one
+            if (epoch_.load() == epoch)
+                return &counter;
+            counter.fetch_sub(1);
+        }
+    }
+
+    static const size_t slots_count = 16;
+    static const size_t cache_line_size = 64;
+
+    struct Slot
+    {
+        std::atomic<long> readers;
+        char padding_[cache_line_size - sizeof(std::atomic<long>)];
+    };
+
+    std::atomic<unsigned long> epoch_;
+    Slot slots_[2][slots_count];
+    std::mutex mutex_;
+};
+
+/**
+ * Pointer to immutable data: readers get current version w/o locking,
+ * writers are serialized, each update publishes a new version and
+ * old one is released after all readers are gone.
+ */
+template <typename T>
+class RcuPtr
+{
+public:
+    typedef std::shared_ptr<T const> value_ptr;
+
+    RcuPtr(value_ptr const &v) : current_(new value_ptr(v)) {}
+
+    RcuPtr(RcuPtr const &from) : current_(new value_ptr(from.get())) {}
+
+    RcuPtr& operator = (RcuPtr const&) = delete;
+
+    ~RcuPtr()
+    {
+        delete current_.load();
+    }
+
+    /// snapshot of the current version
+    value_ptr get() const
+    {
+        Rcu::ReadSection read;
+        return *current_.load(std::memory_order_acquire);
+    }
+
+    /// fn(T const&) is executed on the current version w/o copying
+    /// shared pointer, it should be short and should not update any
+    /// RcuPtr
+    template <typename FnT>
+    auto read(FnT fn) const -> decltype(fn(std::declval<T const&>()))
+    {
+        Rcu::ReadSection read;
+        return fn(**current_.load(std::memory_order_acquire));
+    }
+
+    /// fn(T&) modifies copy of the current version, copy is
+    /// published if fn returns true
+    template <typename FnT>
+    void update(FnT fn)
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        auto v = std::make_shared<T>(**current_.load());
+        if (!fn(*v))
+            return;
+        replace_(v);
+    }
+
+    void set(value_ptr const &v)
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        replace_(v);
+    }
+
+private:
+
+    void replace_(value_ptr const &v)
+    {
+        auto old = current_.exchange(new value_ptr(v));
+        Rcu::instance().synchronize();
+        delete old;
+    }
+
+    std::atomic<value_ptr*> current_;
+    std::mutex write_mutex_;
+};
+
+} // metafuse
+
+#endif // _METAFUSE_RCU_HPP_
@@ -21,6 +21,7 @@
 #include <iostream>
 
 #include <stdio.h>
+#include <string.h>
 #include <stdbool.h>
 #include <poll.h>
 
@@ -168,6 +169,8 @@ std::basic_ostream<CharT> & operator <<
         else
             out << " :access wonly";
     }
+    if (src.min_interval())
+        out << " :min-interval " << src.min_interval();
     out << ")";
 
     return out;
@@ -332,8 +335,12 @@ std::string to_nl_string(property_type const &p)
 
 Property::Property(std::string const &name,
                    property_type const &defval,
-                   unsigned access)
-    : ObjectExpr(name), defval_(defval), access_(access)
+                   unsigned access,
+                   long min_interval)
+    : ObjectExpr(name)
+    , defval_(defval)
+    , access_(access)
+    , min_interval_(min_interval)
 {}
 
 Namespace::Namespace(std::string const &name, storage_type &&props)
@@ -412,6 +419,17 @@ static bool set_property(property_map_type &dst
     return false;
 };
 
+/// notification rate options: :min-interval (ms) and :max-rate (per
+/// second), the most restrictive is used. Returns -1 if not set
+static long min_interval_get(property_map_type &options)
+{
+    long interval = to_integer(options["min-interval"]);
+    long rate = to_integer(options["max-rate"]);
+    if (rate > 0)
+        interval = std::max(interval, (1000 + rate - 1) / rate);
+    return interval;
+}
+
 nl::env_ptr mk_parse_env()
 {
     using nl::env_ptr;
@@ -455,7 +473,9 @@ nl::env_ptr mk_parse_env()
         property_map_type options = {
             // default option values
             {"behavior", "discrete"},
-            {"access", (long)Property::Read}
+            {"access", (long)Property::Read},
+            {"min-interval", -1L},
+            {"max-rate", 0L}
         };
         auto add_option = [&options](expr_ptr const &k, expr_ptr const &v) {
             set_property(options, k->value(), v);
@@ -465,7 +485,8 @@ nl::env_ptr mk_parse_env()
         if (config::to_string(options["behavior"]) == "discrete")
                 access |= Property::Subscribe;
 
-        nl::expr_ptr res(new Property(name, defval, access));
+        nl::expr_ptr res(new Property(name, defval, access
+                                      , min_interval_get(options)));
 
         return res;
     };
@@ -476,7 +497,26 @@ nl::env_ptr mk_parse_env()
         src.required(to_string, name);
 
         Namespace::storage_type props;
-        nl::push_rest_casted(src, props);
+        property_map_type options = {
+            // namespace-wide defaults for properties
+            {"min-interval", -1L},
+            {"max-rate", 0L}
+        };
+        auto add_prop = [&props](expr_ptr &v) {
+            auto prop = std::dynamic_pointer_cast<Property>(v);
+            if (!prop)
+                throw cor::Error("Can't be casted to Property");
+            props.push_back(prop);
+        };
+        auto set_option = [&options](expr_ptr const &k, expr_ptr const &v) {
+            set_property(options, k->value(), v);
+        };
+        nl::rest(src, add_prop, set_option);
+        auto interval = min_interval_get(options);
+        if (interval >= 0) {
+            for (auto &prop : props)
+                prop->min_interval_default(interval);
+        }
         nl::expr_ptr res(new Namespace(name, std::move(props)));
         return res;
     };
@@ -546,10 +586,8 @@ void Monitor::lib_add(std::string const &cfg_path, Monitor::lib_ptr p)
     process_lib_info(p , provider_add, loader_add);
 }
 
-static Namespace::prop_type from_api
-(statefs_property const *prop, statefs_io &io)
+static Namespace::prop_type from_api(statefs_property const *prop, int attr)
 {
-    int attr = io.getattr(prop);
     auto defval = statefs_variant_2prop(&prop->default_value);
     unsigned access = 0;
     if (attr & STATEFS_ATTR_DISCRETE)
@@ -565,8 +603,35 @@ typedef cor::Handle<
     cor::GenericHandleTraits<
         intptr_t, 0> > branch_handle_type;
 
+/// attributes are requested at once if provider supports read_many
+static std::vector<int> attributes_get
+(statefs_namespace const *ns, statefs_provider *provider
+ , std::vector<property_handle_type> const &props)
+{
+    std::vector<int> res;
+    res.reserve(props.size());
+    if (statefs_has_read_many(provider) && !props.empty()) {
+        std::vector<statefs_slice> slices(props.size());
+        for (size_t i = 0; i < props.size(); ++i) {
+            memset(&slices[i], 0, sizeof(slices[i]));
+            slices[i].property = props[i].get();
+        }
+        int rc = provider->io.read_many
+            (const_cast<statefs_namespace*>(ns), &slices[0], slices.size());
+        if (rc == (int)slices.size()) {
+            for (auto const &slice : slices)
+                res.push_back(slice.attr);
+            return res;
+        }
+        std::cerr << "read_many failed: " << rc << std::endl;
+    }
+    for (auto const &prop : props)
+        res.push_back(provider->io.getattr(prop.get()));
+    return res;
+}
+
 static Plugin::ns_type from_api
-(statefs_namespace const *ns, statefs_io &io)
+(statefs_namespace const *ns, statefs_provider *provider)
 {
     auto ns_name = ns->node.name;
 
@@ -579,13 +644,17 @@ static Plugin::ns_type from_api
         return mk_property_handle
         (statefs_prop_get(&ns->branch, iter.value()));
     };
+    std::vector<property_handle_type> handles;
     auto prop = next();
-    Namespace::storage_type props;
     while (prop) {
-        props.push_back(from_api(prop.get(), io));
+        handles.push_back(std::move(prop));
         statefs_next(&ns->branch, &iter.ref());
         prop = next();
     }
+    auto attrs = attributes_get(ns, provider, handles);
+    Namespace::storage_type props;
+    for (size_t i = 0; i < handles.size(); ++i)
+        props.push_back(from_api(handles[i].get(), attrs[i]));
     return std::make_shared<Namespace>(ns_name, std::move(props));
 }
 
@@ -621,7 +690,7 @@ static std::shared_ptr<Plugin> from_api
     auto pns = next();
     Plugin::storage_type namespaces;
     while (pns) {
-        namespaces.push_back(from_api(pns.get(), provider_->io));
+        namespaces.push_back(from_api(pns.get(), provider_.get()));
         statefs_next(&root.branch, &iter.ref());
         pns = next();
     }
@@ -10,7 +10,11 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
 
 namespace statefs { namespace consumer {
 
@@ -43,12 +47,146 @@ cor::FdHandle try_open_in_property(std::string const &name, Prefer prefer)
     return res;
 }
 
-// void monitor_path(std::string const &path, receiver_type receiver)
-// {
-// }
+Monitor::Monitor()
+    : epoll_(::epoll_create1(EPOLL_CLOEXEC))
+    , buf_(1024)
+{
+    if (!epoll_.is_valid())
+        throw cor::Error("Can't create epoll: %s", ::strerror(errno));
+}
+
+Monitor::~Monitor() {}
+
+bool Monitor::add(cor::FdHandle &&fd, receiver_type const &receiver)
+{
+    if (!fd.is_valid()) {
+        receiver(Status::NotExists, "");
+        return false;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLPRI;
+    ev.data.fd = fd.value();
+    if (::epoll_ctl(epoll_.value(), EPOLL_CTL_ADD, fd.value(), &ev) < 0) {
+        receiver(Status::Error, ::strerror(errno));
+        return false;
+    }
+    auto id = fd.value();
+    items_[id].reset(new Item(std::move(fd), receiver));
+    return true;
+}
+
+bool Monitor::add_path(std::string const &path, receiver_type receiver)
+{
+    return add(cor::FdHandle{::open(path.c_str(), O_RDONLY)}, receiver);
+}
+
+bool Monitor::add_property(std::string const &name, receiver_type receiver
+                           , Prefer prefer)
+{
+    return add(try_open_in_property(name, prefer), receiver);
+}
+
+void Monitor::remove(int fd)
+{
+    ::epoll_ctl(epoll_.value(), EPOLL_CTL_DEL, fd, nullptr);
+    items_.erase(fd);
+}
+
+/// whole value is read into buf_, buffer grows if needed
+int Monitor::read(Item &item)
+{
+    while (true) {
+        auto rc = ::pread(item.fd.value(), &buf_[0], buf_.size(), 0);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        if ((size_t)rc < buf_.size())
+            return rc;
+        buf_.resize(buf_.size() * 2);
+    }
+}
+
+int Monitor::process(int timeout)
+{
+    if (items_.empty())
+        return 0;
+
+    static const int max_events = 64;
+    struct epoll_event events[max_events];
+    int count;
+    do {
+        count = ::epoll_wait(epoll_.value(), events, max_events, timeout);
+    } while (count < 0 && errno == EINTR);
+    if (count < 0)
+        return -errno;
+
+    struct Change
+    {
+        int fd;
+        Status status;
+        std::string value;
+    };
+
+    // all values are read first, so receivers get consistent batch
+    std::vector<Change> changes;
+    changes.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        auto fd = events[i].data.fd;
+        auto p = items_.find(fd);
+        if (p == items_.end())
+            continue;
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+            changes.push_back(Change{fd, Status::Error, "poll error"});
+            continue;
+        }
+        auto rc = read(*p->second);
+        if (rc < 0)
+            changes.push_back(Change{fd, Status::Error, ::strerror(-rc)});
+        else
+            changes.push_back(Change{fd, Status::Ok, std::string(&buf_[0], rc)});
+    }
+
+    // property is not monitored anymore after error. Items are
+    // removed after dispatching, so fd numbers of pending changes are
+    // not reused if receiver adds new property
+    std::vector<int> stopped;
+    for (auto const &c : changes) {
+        auto p = items_.find(c.fd);
+        if (p == items_.end())
+            continue;
+        if (p->second->receiver(c.status, c.value) == Flow::Stop
+            || c.status != Status::Ok)
+            stopped.push_back(c.fd);
+    }
+    for (auto fd : stopped)
+        remove(fd);
+    return changes.size();
+}
+
+void Monitor::run()
+{
+    while (!items_.empty()) {
+        auto rc = process();
+        if (rc < 0)
+            throw cor::Error("Monitor failed: %s", ::strerror(-rc));
+    }
+}
 
-// void monitor_property(std::string const &path, receiver_type receiver)
-// {
-// }
+void monitor_path(std::string const &path, receiver_type receiver)
+{
+    Monitor monitor;
+    if (monitor.add_path(path, receiver))
+        monitor.run();
+}
+
+void monitor_property(std::string const &name, receiver_type receiver)
+{
+    Monitor monitor;
+    if (monitor.add_property(name, receiver))
+        monitor.run();
+}
 
 }}
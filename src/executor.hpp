@@ -0,0 +1,355 @@
+#ifndef _STATEFS_EXECUTOR_HPP_
+#define _STATEFS_EXECUTOR_HPP_
+/**
+ * @file executor.hpp
+ * @brief Statefs server: shared worker pool executing provider
+ * notifications
+ *
+ * @author (C) 2012, 2013 Jolla Ltd. Denis Zalevskiy <denis.zalevskiy@jollamobile.com>
+ * @copyright LGPL 2.1 http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include <time.h>
+
+namespace statefs { namespace server {
+
+/// monotonic time in milliseconds, 64-bit: 32-bit long overflows
+/// after ~24.8 days of uptime
+static inline long long monotonic_ms()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/// monotonic time in microseconds
+static inline long long monotonic_us()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Executes tasks at the specified (monotonic_ms) time. Thread is
+ * started only if something is scheduled
+ */
+class DelayedTasks
+{
+public:
+    DelayedTasks() : is_stopped_(false) {}
+    DelayedTasks(DelayedTasks const&) = delete;
+    DelayedTasks& operator = (DelayedTasks const&) = delete;
+
+    ~DelayedTasks()
+    {
+        stop();
+    }
+
+    bool schedule(long long at, std::function<void()> task)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (is_stopped_)
+            return false;
+        if (!thread_.joinable())
+            thread_ = std::thread([this]() { run(); });
+        tasks_.insert(std::make_pair(at, std::move(task)));
+        cond_.notify_one();
+        return true;
+    }
+
+    /// pending tasks are dropped
+    void stop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        is_stopped_ = true;
+        tasks_.clear();
+        cond_.notify_one();
+        lock.unlock();
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+private:
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!is_stopped_) {
+            if (tasks_.empty()) {
+                cond_.wait(lock);
+                continue;
+            }
+            auto first = tasks_.begin();
+            auto now = monotonic_ms();
+            if (first->first > now) {
+                cond_.wait_for
+                    (lock, std::chrono::milliseconds(first->first - now));
+                continue;
+            }
+            auto task = std::move(first->second);
+            tasks_.erase(first);
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::multimap<long long, std::function<void()> > tasks_;
+    std::thread thread_;
+    bool is_stopped_;
+};
+
+class SerialQueue;
+
+/**
+ * Server-wide pool of workers executing serial queues. Each worker
+ * has its own queue of ready serial queues, idle workers are stealing
+ * from other workers. Workers are started on the first submission,
+ * by default there is a worker per cpu core.
+ *
+ * Executor is never destroyed: provider can exit the process from
+ * the worker thread.
+ */
+class Executor
+{
+public:
+    typedef std::shared_ptr<SerialQueue> queue_ptr;
+
+    static Executor& instance()
+    {
+        static Executor *self = new Executor();
+        return *self;
+    }
+
+    /// should be called before the first submission, 0 - cpu count
+    void threads_count_set(size_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!is_started_.load())
+            threads_count_ = count;
+    }
+
+    void submit(queue_ptr const &);
+
+    /// task is executed at the specified time (monotonic_ms) by the
+    /// timer thread, it should be short
+    bool schedule(long long at, std::function<void()> task)
+    {
+        return delayed_.schedule(at, std::move(task));
+    }
+
+private:
+
+    Executor()
+        : threads_count_(0), is_started_(false), next_(0), pending_(0)
+    {}
+    Executor(Executor const&) = delete;
+    Executor& operator = (Executor const&) = delete;
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<queue_ptr> ready;
+    };
+
+    void start();
+    void run(size_t);
+    bool pop(size_t, queue_ptr &);
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    size_t threads_count_;
+    std::atomic<bool> is_started_;
+    std::vector<std::unique_ptr<Worker> > workers_;
+    std::atomic<size_t> next_;
+    std::atomic<long> pending_;
+    DelayedTasks delayed_;
+};
+
+/**
+ * Tasks enqueued to the serial queue are executed by the shared
+ * Executor one by one in the order of enqueuing
+ */
+class SerialQueue : public std::enable_shared_from_this<SerialQueue>
+{
+public:
+    typedef std::packaged_task<void()> task_type;
+
+    static std::shared_ptr<SerialQueue> create()
+    {
+        return std::shared_ptr<SerialQueue>(new SerialQueue());
+    }
+
+    bool enqueue(task_type &&task)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (is_stopped_)
+            return false;
+        tasks_.push_back(std::move(task));
+        if (is_scheduled_)
+            return true;
+        is_scheduled_ = true;
+        lock.unlock();
+        Executor::instance().submit(shared_from_this());
+        return true;
+    }
+
+    /// task is enqueued at the specified time (monotonic_ms)
+    bool enqueue_at(long long at, std::function<void()> task)
+    {
+        std::weak_ptr<SerialQueue> wself(shared_from_this());
+        auto fn = [wself, task]() {
+            auto self = wself.lock();
+            if (self)
+                self->enqueue(task_type{task});
+        };
+        return Executor::instance().schedule(at, fn);
+    }
+
+    /**
+     * Pending tasks are dropped, waits for the currently executed
+     * one to be completed. Should not be called from the task
+     */
+    void stop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        is_stopped_ = true;
+        tasks_.clear();
+        while (is_running_)
+            cond_.wait(lock);
+    }
+
+    /// executed by the worker, returns true if there are more tasks
+    /// to execute
+    bool run()
+    {
+        for (size_t i = 0; i < batch_size; ++i) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            is_running_ = false;
+            if (is_stopped_ || tasks_.empty()) {
+                is_scheduled_ = false;
+                cond_.notify_all();
+                return false;
+            }
+            auto task = std::move(tasks_.front());
+            tasks_.pop_front();
+            is_running_ = true;
+            lock.unlock();
+            task();
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_running_ = false;
+        cond_.notify_all();
+        is_scheduled_ = !(is_stopped_ || tasks_.empty());
+        return is_scheduled_;
+    }
+
+private:
+
+    SerialQueue()
+        : is_scheduled_(false), is_running_(false), is_stopped_(false)
+    {}
+
+    /// max number of tasks executed in a row, after it queue is
+    /// resubmitted to give a chance to other queues
+    static const size_t batch_size = 16;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<task_type> tasks_;
+    bool is_scheduled_;
+    bool is_running_;
+    bool is_stopped_;
+};
+
+inline void Executor::submit(queue_ptr const &q)
+{
+    if (!is_started_.load(std::memory_order_acquire))
+        start();
+    auto &w = *workers_[next_.fetch_add(1) % workers_.size()];
+    {
+        std::lock_guard<std::mutex> lock(w.mutex);
+        w.ready.push_back(q);
+    }
+    pending_.fetch_add(1);
+    std::lock_guard<std::mutex> lock(mutex_);
+    cond_.notify_one();
+}
+
+inline void Executor::start()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (is_started_.load())
+        return;
+    auto count = threads_count_ ? threads_count_
+        : std::thread::hardware_concurrency();
+    if (!count)
+        count = 1;
+    std::vector<std::unique_ptr<Worker> > workers;
+    for (size_t i = 0; i < count; ++i)
+        workers.push_back(std::unique_ptr<Worker>(new Worker()));
+    workers_ = std::move(workers);
+    is_started_.store(true, std::memory_order_release);
+    for (size_t i = 0; i < count; ++i)
+        std::thread([this, i]() { run(i); }).detach();
+}
+
+inline bool Executor::pop(size_t id, queue_ptr &q)
+{
+    auto count = workers_.size();
+    for (size_t i = 0; i < count; ++i) {
+        auto &w = *workers_[(id + i) % count];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if (w.ready.empty())
+            continue;
+        // own queues are taken from the head, stolen - from the tail
+        if (!i) {
+            q = std::move(w.ready.front());
+            w.ready.pop_front();
+        } else {
+            q = std::move(w.ready.back());
+            w.ready.pop_back();
+        }
+        pending_.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+inline void Executor::run(size_t id)
+{
+    while (true) {
+        queue_ptr q;
+        if (pop(id, q)) {
+            if (q->run())
+                submit(q);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!pending_.load()) {
+            cond_.wait(lock);
+        } else {
+            // queue is being submitted or taken by other worker
+            lock.unlock();
+            std::this_thread::yield();
+        }
+    }
+}
+
+}} // namespace
+
+#endif // _STATEFS_EXECUTOR_HPP_
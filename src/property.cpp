@@ -16,6 +16,24 @@
 
 namespace statefs {
 
+typedef std::shared_ptr<std::string const> value_ptr;
+
+static void value_view_release(::statefs_view *view)
+{
+    delete static_cast<value_ptr*>(view->ctx);
+}
+
+/// view keeps a reference to the value
+int value_view(value_ptr const &v, ::statefs_view *view)
+{
+    auto ref = new value_ptr(v);
+    view->data = (*ref)->data();
+    view->len = (*ref)->size();
+    view->release = &value_view_release;
+    view->ctx = ref;
+    return 0;
+}
+
 setter_type property_setter(std::shared_ptr<DiscreteProperty> const &p)
 {
     return [p](std::string const &v) mutable {
@@ -47,10 +65,19 @@ int AnalogProperty::read(std::string *h, char *dst, statefs_size_t len, statefs_
     return read_from(*h, dst, len, off);
 }
 
+int AnalogProperty::read_view(std::string *, ::statefs_view *view)
+{
+    if (!source_)
+        return -ENOENT;
+
+    return value_view(std::make_shared<std::string const>
+                      (source_->read()), view);
+}
+
 
 DiscreteProperty::DiscreteProperty
 (statefs::AProperty *parent, std::string const &defval)
-    : parent_(parent), v_(defval)
+    : parent_(parent), v_(std::make_shared<std::string const>(defval))
     , slot_(nullptr)
 {}
 
@@ -70,7 +97,7 @@ void DiscreteProperty::disconnect()
 statefs_ssize_t DiscreteProperty::size() const
 {
     std::lock_guard<std::mutex> lock(m_);
-    return (statefs_ssize_t)v_.size();
+    return (statefs_ssize_t)v_->size();
 }
 
 int DiscreteProperty::read
@@ -78,19 +105,25 @@ int DiscreteProperty::read
 {
     if (!off) {
         std::lock_guard<std::mutex> lock(m_);
-        *h = v_;
+        *h = *v_;
     }
 
     return read_from(*h, dst, len, off);
 }
 
+int DiscreteProperty::read_view(std::string *, ::statefs_view *view)
+{
+    std::lock_guard<std::mutex> lock(m_);
+    return value_view(v_, view);
+}
+
 PropertyStatus DiscreteProperty::update(std::string const &v)
 {
     std::unique_lock<std::mutex> lock(m_);
-    if (v_ == v)
+    if (*v_ == v)
         return PropertyUnchanged;
 
-    v_ = v;
+    v_ = std::make_shared<std::string const>(v);
     if (slot_)
         slot_->on_changed(slot_, parent_);
     lock.unlock();
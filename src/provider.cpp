@@ -9,6 +9,9 @@
 #include <statefs/provider.hpp>
 #include <statefs/util.h>
 #include <cor/util.hpp>
+#include <fcntl.h>
+
+#include <algorithm>
 
 namespace statefs {
 
@@ -27,6 +30,11 @@ PropertyWrapper::~PropertyWrapper() {}
 
 APropertyAccessor::~APropertyAccessor() {}
 
+int APropertyAccessor::read_view(::statefs_view *)
+{
+    return -ENOTSUP;
+}
+
 AProperty::AProperty(char const *name)
     : PropertyWrapper(name)
 {}
@@ -49,14 +57,49 @@ statefs_provider* node_to<statefs_provider>(::statefs_node *n)
 }
 
 BranchStorage::BranchStorage()
+    : is_ready_(false), is_frozen_(false)
 {}
 
+/// sorts children appended since the last call and builds the lookup
+/// table, it is called from const methods invoked by statefs, so it is
+/// guarded by the mutex
+void BranchStorage::prepare() const
+{
+    if (is_ready_.load(std::memory_order_acquire))
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (is_ready_.load(std::memory_order_relaxed))
+        return;
+
+    auto less = [](item_type const &a, item_type const &b) {
+        return a.first < b.first;
+    };
+    auto is_same = [](item_type const &a, item_type const &b) {
+        return a.first == b.first;
+    };
+    // stable: the first inserted child with the same name is kept
+    std::stable_sort(props_.begin(), props_.end(), less);
+    props_.erase(std::unique(props_.begin(), props_.end(), is_same)
+                 , props_.end());
+    build_index();
+    is_ready_.store(true, std::memory_order_release);
+}
+
+/// child with the same name is not replaced. Frozen storage can be
+/// accessed concurrently, so it can't be changed
 BranchStorage::child_ptr BranchStorage::insert(child_ptr child)
 {
-    if (child)
-        props_.insert(
-            std::move(std::make_pair(
-                          child->get_name(), child)));
+    if (!child)
+        return child;
+
+    if (is_frozen_)
+        throw cor::Error("Can't insert %s into frozen branch",
+                         child->get_name().c_str());
+
+    props_.push_back(std::make_pair(child->get_name(), child));
+    // positions are changed, table is rebuilt on the next access
+    is_ready_.store(false, std::memory_order_release);
     return child;
 }
 
@@ -67,25 +110,79 @@ BranchStorage::child_ptr BranchStorage::insert(ANode *child)
 }
 
 
+/// FNV-1a
+static inline uint32_t name_hash(char const *name)
+{
+    uint32_t res = 2166136261u;
+    for (; *name; ++name) {
+        res ^= (unsigned char)*name;
+        res *= 16777619u;
+    }
+    return res;
+}
+
+void BranchStorage::build_index() const
+{
+    size_t size = 8;
+    // load factor is kept <= 0.5
+    while (size < props_.size() * 2)
+        size <<= 1;
+
+    std::vector<Slot> index(size);
+    memset(&index[0], 0, sizeof(Slot) * size);
+    auto mask = size - 1;
+    for (size_t i = 0; i < props_.size(); ++i) {
+        auto const &name = props_[i].first;
+        auto hash = name_hash(name.c_str());
+        auto pos = hash & mask;
+        while (index[pos].pos)
+            pos = (pos + 1) & mask;
+
+        auto &slot = index[pos];
+        slot.hash = hash;
+        slot.pos = i + 1;
+        if (name.size() < sizeof(slot.name)) {
+            memcpy(slot.name, name.c_str(), name.size() + 1);
+            slot.is_inline = 1;
+        }
+    }
+    index_.swap(index);
+}
+
+void BranchStorage::freeze()
+{
+    prepare();
+    is_frozen_ = true;
+    for (auto const &item : props_) {
+        auto ns = dynamic_cast<Namespace*>(item.second.get());
+        if (ns)
+            ns->freeze();
+    }
+}
+
 statefs_node * BranchStorage::find(char const *name) const
 {
-    auto iter = props_.find(name);
-    if (iter == props_.end())
-        return nullptr;
-    auto const &p = iter->second;
-    return p.get()->get_node();
+    prepare();
+    auto hash = name_hash(name);
+    auto mask = index_.size() - 1;
+    for (auto pos = hash & mask; index_[pos].pos; pos = (pos + 1) & mask) {
+        auto const &slot = index_[pos];
+        if (slot.hash != hash)
+            continue;
+        auto const &item = props_[slot.pos - 1];
+        if (!strcmp(slot.is_inline ? slot.name : item.first.c_str(), name))
+            return item.second->get_node();
+    }
+    return nullptr;
 }
 
 statefs_node * BranchStorage::get(statefs_handle_t h) const
 {
-    auto piter = cor::tagged_handle_pointer<iter_type>(h);
-    if (!piter)
-        return nullptr;
-
-    if (*piter == props_.end())
+    prepare();
+    if (h <= 0 || (size_t)h > props_.size())
         return nullptr;
 
-    auto const &p = (*piter)->second;
+    auto const &p = props_[h - 1].second;
     if (!p)
         throw cor::Error("Child is not initialized");
     return p.get()->get_node();
@@ -93,19 +190,19 @@ statefs_node * BranchStorage::get(statefs_handle_t h) const
 
 statefs_handle_t BranchStorage::first() const
 {
-    return cor::new_tagged_handle<iter_type>(props_.begin());
+    prepare();
+    return 1;
 }
 
 void BranchStorage::next(statefs_handle_t *h) const
 {
-    auto p = cor::tagged_handle_pointer<iter_type>(*h);
-    if (p)
-        ++*p;
+    if (h && *h > 0)
+        ++*h;
 }
 
-bool BranchStorage::release(statefs_handle_t h) const
+/// nothing is allocated for iteration
+bool BranchStorage::release(statefs_handle_t) const
 {
-    cor::delete_tagged_handle<iter_type>(h);
     return true;
 }
 
@@ -174,7 +271,9 @@ const statefs_io AProvider::io_template = {
     &AProvider::write,
     &AProvider::close,
     &AProvider::connect,
-    &AProvider::disconnect
+    &AProvider::disconnect,
+    &AProvider::read_view,
+    &AProvider::read_many
 };
 
 int AProvider::getattr(::statefs_property const *p)
@@ -207,6 +306,31 @@ int AProvider::write(statefs_handle_t h, char const* src, statefs_size_t len, st
     return impl->write(src, len, off);
 }
 
+int AProvider::read_view(statefs_handle_t h, ::statefs_view *view)
+{
+    auto impl = reinterpret_cast<APropertyAccessor*>(h);
+    return impl->read_view(view);
+}
+
+/// properties are read one by one, each property is locked by its
+/// own implementation, so values are not consistent: library has no
+/// provider-wide lock shared with property updates
+int AProvider::read_many(::statefs_namespace *, ::statefs_slice *slices
+                         , statefs_size_t count)
+{
+    for (statefs_size_t i = 0; i < count; ++i) {
+        auto &slice = slices[i];
+        auto impl = AProperty::self_cast(slice.property);
+        slice.attr = impl->getattr();
+        slice.len = 0;
+        if (!slice.data || !(slice.attr & STATEFS_ATTR_READ))
+            continue;
+        std::unique_ptr<APropertyAccessor> h(impl->open(O_RDONLY));
+        slice.len = h ? h->read(slice.data, slice.size, 0) : -EINVAL;
+    }
+    return count;
+}
+
 void AProvider::close(statefs_handle_t h)
 {
     auto impl = reinterpret_cast<APropertyAccessor*>(h);
@@ -16,6 +16,8 @@
 #include <cor/so.hpp>
 #include <cor/util.hpp>
 #include "config.hpp"
+#include "executor.hpp"
+#include "stats.hpp"
 
 #include <boost/algorithm/string/join.hpp>
 #include <boost/filesystem.hpp>
@@ -26,7 +28,14 @@
 #include <set>
 #include <atomic>
 #include <fstream>
+#include <sstream>
+#include <deque>
+#include <algorithm>
 #include <signal.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 #include "fuse_lowlevel.h"
@@ -43,6 +52,378 @@ using namespace metafuse;
 using statefs::provider_ptr;
 namespace config = statefs::config;
 
+/// kernel cache timeouts (seconds), used by the low-level backend
+struct CachePolicy
+{
+    CachePolicy()
+        : structure(3600), discrete(3600), continuous(1)
+        , is_discrete_kept(false)
+    {}
+
+    /// tree structure is changed only on configuration update
+    CacheTimeouts structure_timeouts() const
+    {
+        return CacheTimeouts(structure, structure);
+    }
+
+    /// discrete property attributes are invalidated on change
+    CacheTimeouts discrete_timeouts() const
+    {
+        return CacheTimeouts(structure, discrete);
+    }
+
+    CacheTimeouts continuous_timeouts() const
+    {
+        return CacheTimeouts(structure, continuous);
+    }
+
+    /// is discrete property data kept in the kernel page cache while
+    /// it is not changed, used only if cache can be invalidated
+    bool is_discrete_data_kept() const
+    {
+        return is_discrete_kept
+            && KernelNotifier::instance().is_attached();
+    }
+
+    double structure;
+    double discrete;
+    double continuous;
+    bool is_discrete_kept;
+};
+
+static CachePolicy cache_policy;
+
+/**
+ * Poll wakeups of changed property handles are collected and sent
+ * together when batch is full or latency budget expires (0 - at the
+ * end of each property notification), each poll handle is notified
+ * only once
+ */
+class PollWakeups
+{
+public:
+    PollWakeups()
+        : batch_size(64), latency(0)
+        , requested_(0), sent_(0), is_flush_scheduled_(false)
+    {}
+
+    /// handle was changed, ph can be empty if nobody polls it
+    void add(poll_handle_type &&ph)
+    {
+        requested_.fetch_add(1, std::memory_order_relaxed);
+        if (!ph)
+            return;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        pending_.push_back(std::move(ph));
+        if (pending_.size() < batch_size)
+            return;
+        std::vector<poll_handle_type> batch;
+        batch.swap(pending_);
+        lock.unlock();
+        send(batch);
+    }
+
+    /// called when changes are processed
+    void commit()
+    {
+        if (latency <= 0) {
+            flush();
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (is_flush_scheduled_ || pending_.empty())
+            return;
+        is_flush_scheduled_ = true;
+        Executor::instance().schedule
+            (monotonic_ms() + latency, [this]() { flush(); });
+    }
+
+    void flush()
+    {
+        std::vector<poll_handle_type> batch;
+        std::unique_lock<std::mutex> lock(mutex_);
+        is_flush_scheduled_ = false;
+        batch.swap(pending_);
+        lock.unlock();
+        send(batch);
+    }
+
+    /// number of handle change notifications
+    unsigned long requested() const
+    {
+        return requested_.load(std::memory_order_relaxed);
+    }
+
+    /// number of poll notifications sent to the kernel
+    unsigned long sent() const
+    {
+        return sent_.load(std::memory_order_relaxed);
+    }
+
+    size_t batch_size;
+    long latency;
+
+private:
+
+    void send(std::vector<poll_handle_type> &batch)
+    {
+        if (batch.empty())
+            return;
+        auto less = [](poll_handle_type const &a, poll_handle_type const &b) {
+            return a.get() < b.get();
+        };
+        auto equal = [](poll_handle_type const &a, poll_handle_type const &b) {
+            return a.get() == b.get();
+        };
+        std::sort(batch.begin(), batch.end(), less);
+        auto end = std::unique(batch.begin(), batch.end(), equal);
+        for (auto p = batch.begin(); p != end; ++p)
+            fuse_notify_poll(p->get());
+        sent_.fetch_add(end - batch.begin(), std::memory_order_relaxed);
+    }
+
+    std::mutex mutex_;
+    std::vector<poll_handle_type> pending_;
+    std::atomic<unsigned long> requested_;
+    std::atomic<unsigned long> sent_;
+    bool is_flush_scheduled_;
+};
+
+static PollWakeups poll_wakeups;
+
+/**
+ * Kernel does not generate inotify events for fuse files if they
+ * are changed by the server (cache invalidation is not reported). To
+ * let inotify users to get notifications w/o polling changed discrete
+ * property file is truncated to its current size through the mount
+ * point (truncate is a no-op for property files): it produces
+ * IN_MODIFY event for the property file and its provider namespace
+ * directory. After provider is loaded its discrete properties stay
+ * connected to receive changes, no provider handles are opened for
+ * this.
+ */
+class FsNotifyCompat
+{
+public:
+    FsNotifyCompat() : is_enabled(false) {}
+
+    /// is set when filesystem is mounted
+    void mountpoint_set(char const *path)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        mountpoint_ = path ? path : "";
+    }
+
+    /// should not be called from the fuse request handler
+    void touch(std::string const &path)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (mountpoint_.empty())
+            return;
+        auto full_path = mountpoint_ + "/" + path;
+        lock.unlock();
+        struct stat st;
+        if (::stat(full_path.c_str(), &st) < 0
+            || ::truncate(full_path.c_str(), st.st_size) < 0)
+            trace() << "Can't touch " << full_path << ": "
+                    << ::strerror(errno) << std::endl;
+    }
+
+    bool is_enabled;
+
+private:
+    std::mutex mutex_;
+    std::string mountpoint_;
+};
+
+static FsNotifyCompat fsnotify_compat;
+
+/**
+ * Stream of property change records shared by all readers, each
+ * record is a line "<name> <sequence> <value>\n", new lines in the
+ * value are replaced with spaces. Only last records are kept, reader
+ * lagging behind loses the oldest ones and gets "! lost <count>\n"
+ * record instead.
+ *
+ * Properties are watched (watch(true) is called) only while stream
+ * has readers.
+ */
+class EventStream
+{
+public:
+    typedef std::function<void(bool)> watch_type;
+
+    EventStream(size_t capacity = 1024)
+        : first_(0), readers_(0), is_stopped_(false), capacity_(capacity)
+    {}
+
+    EventStream(EventStream const&) = delete;
+    EventStream& operator = (EventStream const&) = delete;
+
+    /// should be set before stream is used
+    void watch_set(watch_type const &watch)
+    {
+        watch_ = watch;
+    }
+
+    bool is_watched() const
+    {
+        return readers_.load(std::memory_order_relaxed) > 0;
+    }
+
+    void append(std::string const &name, unsigned long seq
+                , std::string const &value)
+    {
+        if (!is_watched())
+            return;
+
+        std::ostringstream out;
+        out << name << " " << seq << " ";
+        auto len = std::min(value.size(), max_value_size);
+        if (len && value[len - 1] == '\n')
+            --len;
+        for (size_t i = 0; i < len; ++i)
+            out << (value[i] == '\n' ? ' ' : value[i]);
+        out << "\n";
+
+        std::map<void const*, poll_handle_type> pollers;
+        std::unique_lock<std::mutex> lock(mutex_);
+        records_.push_back(out.str());
+        if (records_.size() > capacity_) {
+            records_.pop_front();
+            ++first_;
+        }
+        pollers.swap(pollers_);
+        cond_.notify_all();
+        lock.unlock();
+
+        for (auto &p : pollers)
+            poll_wakeups.add(std::move(p.second));
+        poll_wakeups.commit();
+    }
+
+    /// @return position of the new reader
+    unsigned long attach()
+    {
+        std::lock_guard<std::mutex> watch_lock(watch_mutex_);
+        if (!readers_.fetch_add(1) && watch_) {
+            try {
+                watch_(true);
+            } catch (...) {
+                readers_.fetch_sub(1);
+                throw;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        return end();
+    }
+
+    void detach(void const *reader)
+    {
+        std::lock_guard<std::mutex> watch_lock(watch_mutex_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pollers_.erase(reader);
+        }
+        if (readers_.fetch_sub(1) == 1 && watch_)
+            watch_(false);
+    }
+
+    /**
+     * read whole records starting from the reader position. If there
+     * is nothing to read it is blocked until record is appended or
+     * returns -EAGAIN if is_blocking is false. Blocked reader checks
+     * every 200ms if fuse request is interrupted (or the reader
+     * process is gone for high-level fuse) and returns -EINTR, so it
+     * does not pin the fuse thread. Reader handling signals should use
+     * O_NONBLOCK and poll()
+     */
+    int read(unsigned long &pos, char *buf, size_t size, bool is_blocking)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (pos >= end()) {
+            if (is_stopped_)
+                return 0;
+            if (!is_blocking)
+                return -EAGAIN;
+            if (metafuse::is_interrupted())
+                return -EINTR;
+            cond_.wait_for(lock, std::chrono::milliseconds(200));
+        }
+
+        size_t done = 0;
+        if (pos < first_) {
+            std::ostringstream out;
+            out << "! lost " << (first_ - pos) << "\n";
+            auto lost = out.str();
+            if (lost.size() > size)
+                return -EINVAL;
+            memcpy(buf, lost.data(), lost.size());
+            done = lost.size();
+            pos = first_;
+        }
+        for (; pos < end(); ++pos) {
+            auto const &record = records_[pos - first_];
+            if (done + record.size() > size)
+                break;
+            memcpy(buf + done, record.data(), record.size());
+            done += record.size();
+        }
+        // as inotify, it does not split records
+        return done ? done : -EINVAL;
+    }
+
+    /// reader is notified when record is appended
+    bool poll(void const *reader, unsigned long pos, poll_handle_type &ph)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pos < end() || is_stopped_)
+            return true;
+        if (ph)
+            pollers_[reader] = ph;
+        return false;
+    }
+
+    /// blocked readers are woken up
+    void stop()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_stopped_ = true;
+        cond_.notify_all();
+    }
+
+private:
+
+    static const size_t max_value_size = 1024;
+
+    unsigned long end() const
+    {
+        return first_ + records_.size();
+    }
+
+    std::mutex watch_mutex_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<std::string> records_;
+    unsigned long first_;
+    std::map<void const*, poll_handle_type> pollers_;
+    watch_type watch_;
+    std::atomic<long> readers_;
+    bool is_stopped_;
+    size_t capacity_;
+};
+
+/// all changes of watched properties, qualified with namespace
+static EventStream& root_events()
+{
+    static EventStream self(4096);
+    return self;
+}
+
+/// name of the event stream file, it can't clash with property names
+static char const *events_file_name = ".events";
+
 class ProviderBridge : public statefs_server
 {
 public:
@@ -62,6 +443,18 @@ public:
         return loaded() ? &(provider_->io) : nullptr;
     }
 
+    /// provider can expose values w/o copying (statefs_io.read_view)
+    bool has_read_view() const
+    {
+        return loaded() && statefs_has_read_view(provider_.get());
+    }
+
+    /// provider can read several values at once (statefs_io.read_many)
+    bool has_read_many() const
+    {
+        return loaded() && statefs_has_read_many(provider_.get());
+    }
+
     void on_provider_event(statefs_provider *p, statefs_event e)
     {
         if (e == statefs_event_reload) {
@@ -99,7 +492,8 @@ private:
 class Namespace
 {
 public:
-    Namespace(ns_handle_type &&h);
+    Namespace(ns_handle_type &&h, statefs_io *io = nullptr
+              , bool has_read_many = false);
 
     ~Namespace() { }
 
@@ -110,6 +504,19 @@ public:
 
     property_handle_type property(std::string const &name) const;
 
+    bool has_read_many() const
+    {
+        return read_many_ != nullptr;
+    }
+
+    /// -ENOTSUP if provider does not support reading many values
+    int read_many(statefs_slice *slices, size_t count) const
+    {
+        return (exists() && read_many_)
+            ? read_many_(handle_.get(), slices, count)
+            : -ENOTSUP;
+    }
+
 private:
 
     static void property_release(statefs_property *p)
@@ -119,12 +526,14 @@ private:
     };
 
     ns_handle_type handle_;
+    int (*read_many_)(statefs_namespace *, statefs_slice *, statefs_size_t);
 };
 
 class Property
 {
 public:
-    Property(statefs_io *io, property_handle_type &&h);
+    Property(statefs_io *io, property_handle_type &&h
+             , bool has_read_view = false);
 
     bool exists() const
     {
@@ -160,6 +569,19 @@ public:
     int read(intptr_t, char *, size_t, off_t) const;
     int write(intptr_t, char const*, size_t, off_t) const;
 
+    bool has_read_view() const
+    {
+        return read_view_ != nullptr;
+    }
+
+    /// -ENOTSUP if provider does not support views
+    int read_view(intptr_t h, statefs_view &view) const
+    {
+        return (exists() && read_view_)
+            ? read_view_(h, &view)
+            : -ENOTSUP;
+    }
+
     size_t size() const
     {
         return exists() ? io_->size(handle_.get()) : 0;
@@ -178,10 +600,16 @@ public:
         return handle_ ? statefs_prop_name(handle_.get()) : "";
     }
 
+    statefs_property *get() const
+    {
+        return handle_.get();
+    }
+
 private:
 
     statefs_io *io_;
     property_handle_type handle_;
+    int (*read_view_)(statefs_handle_t, statefs_view *);
 };
 
 int Property::read(intptr_t h, char *dst, size_t len, off_t off) const
@@ -238,16 +666,24 @@ property_handle_type Namespace::property(std::string const &name) const
           : nullptr));
 }
 
-Property::Property(statefs_io *io, property_handle_type &&h)
+Property::Property(statefs_io *io, property_handle_type &&h
+                   , bool has_read_view)
     : io_(io), handle_(std::move(h))
+    , read_view_(has_read_view ? io->read_view : nullptr)
 {}
 
-Namespace::Namespace(ns_handle_type &&h)
+Namespace::Namespace(ns_handle_type &&h, statefs_io *io
+                     , bool has_read_many)
     : handle_(std::move(h))
+    , read_many_(has_read_many ? io->read_many : nullptr)
 {}
 
 /// file interface implementation used to load provider interface
 /// implementation on accessing file for the first time
+///
+/// If loader file is accessed by inode (low-level fuse backend) it
+/// is not re-resolved after loading, so after loading all operations
+/// are forwarded to the loaded file
 template <typename LoadT>
 class PluginLoadFile : public DefaultFile<PluginLoadFile<LoadT> >
 {
@@ -263,24 +699,48 @@ public:
      *        at the beginning
      */
     PluginLoadFile(LoadT loader, int mode, size_t size)
-        : base_type(mode), load_(loader), size_(size) {}
+        : base_type(mode), load_(loader), size_(size)
+    {
+        // property type is not known until loaded
+        this->cache_timeouts_set(cache_policy.continuous_timeouts());
+    }
 
     int open(struct fuse_file_info &fi)
     {
-        auto loaded = load_();
-        return loaded->open(empty_path(), fi);
+        auto loaded = load();
+        return loaded ? loaded->open(empty_path(), fi) : -ENOENT;
+    }
+
+    int release(struct fuse_file_info &fi)
+    {
+        auto loaded = loaded_get();
+        return loaded ? loaded->release(empty_path(), fi) : 0;
     }
 
     int read(char* buf, size_t size,
              off_t offset, struct fuse_file_info &fi)
     {
-        return -ENOTSUP;
+        auto loaded = loaded_get();
+        return loaded
+            ? loaded->read(empty_path(), buf, size, offset, fi)
+            : -ENOTSUP;
     }
 
     int write(const char* src, size_t size,
               off_t offset, struct fuse_file_info &fi)
     {
-        return -ENOTSUP;
+        auto loaded = loaded_get();
+        return loaded
+            ? loaded->write(empty_path(), src, size, offset, fi)
+            : -ENOTSUP;
+    }
+
+    int getattr(struct stat *buf)
+    {
+        auto loaded = loaded_get();
+        return loaded
+            ? loaded->getattr(empty_path(), buf)
+            : base_type::getattr(buf);
     }
 
     size_t size() const
@@ -288,21 +748,185 @@ public:
         return size_;
     }
 
+    virtual CacheTimeouts cache_timeouts() const
+    {
+        auto loaded = loaded_get();
+        return loaded ? loaded->cache_timeouts() : base_type::cache_timeouts();
+    }
+
 	int poll(struct fuse_file_info &fi,
              poll_handle_type &ph, unsigned *reventsp)
     {
+        auto loaded = loaded_get();
+        if (loaded)
+            return loaded->poll(empty_path(), fi, ph, reventsp);
+
         std::cerr << "Loader file can't be polled\n";
         return 0;
     }
 
 private:
+
+    entry_ptr load()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!loaded_)
+            loaded_ = load_();
+        return loaded_;
+    }
+
+    entry_ptr loaded_get() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return loaded_;
+    }
+
     LoadT load_;
     size_t size_;
+    mutable std::mutex mutex_;
+    entry_ptr loaded_;
+};
+
+/// property value captured once per change (discrete) or per read
+/// from the beginning (continuous), it is shared by all readers. Value
+/// is either copied from provider or referenced through the provider
+/// view
+struct ValueSnapshot
+{
+    ValueSnapshot(unsigned long seq_, unsigned long version_)
+        : seq(seq_), version(version_)
+    {
+        memset(&view, 0, sizeof(view));
+    }
+
+    ~ValueSnapshot()
+    {
+        if (view.release)
+            view.release(&view);
+    }
+
+    ValueSnapshot(ValueSnapshot const&) = delete;
+    ValueSnapshot& operator = (ValueSnapshot const&) = delete;
+
+    char const *begin() const
+    {
+        return view.data ? view.data : data.data();
+    }
+
+    size_t size() const
+    {
+        return view.data ? view.len : data.size();
+    }
+
+    std::string str() const
+    {
+        return std::string(begin(), size());
+    }
+
+    /// the value is read from the provider handle
+    int load(Property const &, intptr_t);
+    /// the value is referenced through the provider view
+    int view_load(Property const &, intptr_t);
+
+    int read(char *buf, size_t size, off_t offset) const
+    {
+        char const *data;
+        size = ref(size, offset, data);
+        memcpy(buf, data, size);
+        return size;
+    }
+
+    /// data is referenced, it is valid while snapshot exists
+    size_t ref(size_t size, off_t offset, char const *&data) const
+    {
+        data = begin();
+        if (offset < 0 || (size_t)offset >= this->size())
+            return 0;
+
+        data += offset;
+        return std::min(size, this->size() - offset);
+    }
+
+    unsigned long seq;
+    unsigned long version;
+    std::string data;
+    statefs_view view;
 };
 
-class StateFsHandle : public FileHandle {
+int ValueSnapshot::view_load(Property const &prop, intptr_t h)
+{
+    int rc = prop.read_view(h, view);
+    if (rc < 0)
+        memset(&view, 0, sizeof(view));
+    return rc;
+}
+
+int ValueSnapshot::load(Property const &prop, intptr_t h)
+{
+    int rc = view_load(prop, h);
+    if (rc != -ENOTSUP)
+        return rc;
+
+    size_t len = std::max(prop.size(), (size_t)64);
+    while (true) {
+        auto pos = data.size();
+        data.resize(pos + len);
+        rc = prop.read(h, &data[pos], len, pos);
+        if (rc < 0)
+            return rc;
+        data.resize(pos + rc);
+        if ((size_t)rc < len)
+            break;
+    }
+    return 0;
+}
+
+typedef std::shared_ptr<ValueSnapshot const> value_snapshot_ptr;
+
+/// provider requires operations on the same handle to be serialized,
+/// so each handle has its own lock
+class StateFsHandle : public FileHandle, public cor::Mutex {
 public:
-    StateFsHandle() : h_(0) {}
+    StateFsHandle() : h_(0), seen_(no_seq) {}
+
+    /// used to reset pooled handle, lock is not copied
+    StateFsHandle& operator = (StateFsHandle const &from)
+    {
+        FileHandle::operator = (from);
+        h_ = from.h_;
+        seen_ = from.seen_;
+        value_ = from.value_;
+        return *this;
+    }
+
+    /// value read from the beginning, the rest is read from it
+    value_snapshot_ptr const& value() const
+    {
+        return value_;
+    }
+
+    void value_set(value_snapshot_ptr const &v)
+    {
+        value_ = v;
+    }
+
+    /// last property change sequence number seen through the handle
+    unsigned long seen() const
+    {
+        return seen_;
+    }
+
+    /// sequence only moves forward, so stale value snapshot can't
+    /// make already reported change ready again
+    void seen_set(unsigned long seq)
+    {
+        if (seen_ == no_seq || seq > seen_)
+            seen_ = seq;
+    }
+
+    /// nothing is seen yet
+    static const unsigned long no_seq = (unsigned long)-1;
+
     void set(intptr_t h)
     {
         h_ = h;
@@ -313,6 +937,8 @@ public:
     }
 private:
     intptr_t h_;
+    unsigned long seen_;
+    value_snapshot_ptr value_;
 };
 
 struct PropertyStorage
@@ -343,7 +969,7 @@ public:
         if (rc >= 0) {
             auto h = prop_->open(fi.flags);
             if (h)
-                handles_[fi.fh]->set(h);
+                handle(fi)->set(h);
             else
                 rc = -1;
         }
@@ -356,16 +982,49 @@ public:
         return base_type::release(fi);
     }
 
+    /// file lock is not held (see PropFileEntry), so reads and
+    /// writes through different handles are not serialized
     int read(char* buf, size_t size,
              off_t offset, struct fuse_file_info &fi)
     {
-        return prop_->read(provider_handle(fi), buf, size, offset);
+        auto h = handle_acquire(fi);
+        if (!h)
+            return -EBADF;
+        auto l(cor::wlock(*h));
+        if (!offset)
+            h->value_set(view_get(h->get()));
+
+        auto const &value = h->value();
+        return value
+            ? value->read(buf, size, offset)
+            : prop_->read(h->get(), buf, size, offset);
+    }
+
+    /// value referenced by provider view is replied directly
+    int read_ref(size_t size, off_t offset,
+                 struct fuse_file_info &fi, ReadRef &dst)
+    {
+        if (!prop_->has_read_view())
+            return -ENOTSUP;
+
+        auto h = handle_acquire(fi);
+        if (!h)
+            return -EBADF;
+        auto l(cor::wlock(*h));
+        if (!offset)
+            h->value_set(view_get(h->get()));
+
+        return value_ref(*h, size, offset, dst);
     }
 
     int write(const char* src, size_t size,
               off_t offset, struct fuse_file_info &fi)
     {
-        return prop_->write(provider_handle(fi), src, size, offset);
+        auto h = handle_acquire(fi);
+        if (!h)
+            return -EBADF;
+        auto l(cor::wlock(*h));
+        return prop_->write(h->get(), src, size, offset);
     }
 
     size_t size() const
@@ -389,14 +1048,9 @@ public:
 
 protected:
 
-    handle_type const* handle(struct fuse_file_info &fi) const
-    {
-        return reinterpret_cast<handle_type const*>(fi.fh);
-    }
-
-    handle_type* handle(struct fuse_file_info &fi)
+    handle_type* handle(struct fuse_file_info &fi) const
     {
-        return reinterpret_cast<handle_type*>(fi.fh);
+        return handles_.get(fi.fh);
     }
 
     intptr_t provider_handle(struct fuse_file_info &fi) const
@@ -404,42 +1058,376 @@ protected:
         auto h = handle(fi);
         return h ? h->get() : 0;
     }
+
+    /// value referenced by provider view, empty if provider
+    /// requires to read value using statefs_io.read
+    value_snapshot_ptr view_get(intptr_t h) const
+    {
+        if (!prop_->has_read_view())
+            return value_snapshot_ptr();
+        auto value = std::make_shared<ValueSnapshot>(0, 0);
+        if (value->view_load(*prop_, h) < 0)
+            return value_snapshot_ptr();
+        return value;
+    }
+
+    /// handle is resolved under the file lock
+    handle_ptr handle_acquire(struct fuse_file_info &fi)
+    {
+        auto l(cor::wlock(*this));
+        return handles_.acquire(fi.fh);
+    }
+
+    /// references handle value snapshot or, if there is no snapshot,
+    /// value read from provider into the buffer owned by dst
+    int value_ref(handle_type &h, size_t size, off_t offset, ReadRef &dst)
+    {
+        auto value = h.value();
+        if (value) {
+            size = value->ref(size, offset, dst.data);
+            dst.holder = value;
+            return size;
+        }
+
+        auto buf = std::make_shared<std::string>(size, '\0');
+        int rc = prop_->read(h.get(), &(*buf)[0], size, offset);
+        if (rc < 0)
+            return rc;
+        dst.data = buf->data();
+        dst.holder = buf;
+        return rc;
+    }
 };
 
 class PluginNsDir;
 
-class DiscretePropFile : public ContinuousPropFile
-{
+class DiscretePropFile : public ContinuousPropFile
+{
+
+    /// used as a bridge between C callback and C++ object
+    static void slot_on_changed
+    (struct statefs_slot *slot, struct statefs_property *)
+    {
+        auto self = cor::member_container(slot, &DiscretePropFile::slot_);
+        self->notify();
+    }
+
+public:
+    DiscretePropFile(PluginNsDir *, std::unique_ptr<Property>, int
+                     , long min_interval = 0);
+    virtual ~DiscretePropFile();
+
+	int poll(struct fuse_file_info &, poll_handle_type &, unsigned *);
+    int open(struct fuse_file_info &);
+    int release(struct fuse_file_info &fi);
+    int read(char*, size_t, off_t, struct fuse_file_info &);
+    int read_ref(size_t, off_t, struct fuse_file_info &, ReadRef &);
+    void notify();
+
+    /// property changes are tracked while it is watched by event
+    /// streams even if it is not opened
+    void watch(bool);
+    /// changes are tracked all the time to generate inotify events
+    void fsnotify_track();
+
+    char const *name() const
+    {
+        return prop_->name();
+    }
+
+    /// value for event streams
+    int value_watched(value_snapshot_ptr &);
+    /// cached value if it is still valid
+    bool value_cached(value_snapshot_ptr &);
+    /// snapshot to be filled by caller reading the value in bulk
+    std::shared_ptr<ValueSnapshot> value_prepare(statefs_slice &);
+    /// filled snapshot is cached if there were no changes since
+    /// it was prepared
+    void value_store(value_snapshot_ptr const &);
+
+    /// change sequence number is exposed as the modification time
+    /// nanoseconds, so consumer can skip reading unchanged value
+    int getattr(struct stat *buf)
+    {
+        int rc = ContinuousPropFile::base_type::getattr(buf);
+        buf->st_mtim.tv_nsec = seq_.load(std::memory_order_relaxed)
+            % 1000000000;
+        return rc;
+    }
+
+private:
+    typedef std::vector<handle_ptr> subscribers_type;
+    typedef std::shared_ptr<subscribers_type const> subscribers_ptr;
+
+    void notify_handles();
+    int value_capture(handle_type &, off_t);
+    void subscribers_update(handle_type const *removed = nullptr);
+    subscribers_ptr subscribers_get() const;
+    int value_get(intptr_t, value_snapshot_ptr &);
+    int value_get_(intptr_t, value_snapshot_ptr &);
+    void value_reset();
+    bool is_tracked() const;
+
+    PluginNsDir *parent_;
+    std::atomic_flag is_notify_;
+    statefs_slot slot_;
+    // notifications rate limit, ms. Last notification time and the
+    // time of the first coalesced change are accessed only by the
+    // thread set is_notify_ flag
+    long min_interval_;
+    long long last_notify_;
+    long long changed_at_;
+    // incremented on each change notification
+    std::atomic<unsigned long> seq_;
+    // incremented on each change reported by provider, even if
+    // notification is coalesced or postponed
+    std::atomic<unsigned long> version_;
+    // last captured value, valid while version_ is not changed
+    std::mutex value_mutex_;
+    value_snapshot_ptr value_;
+    // event streams watching property and provider handle used to
+    // read value for them (protected by value_mutex_)
+    std::atomic<int> watchers_;
+    intptr_t watch_handle_;
+    // connected permanently for FsNotifyCompat (protected by the lock)
+    bool is_fsnotify_;
+    // immutable snapshot of open handles, replaced on open/release,
+    // so notification does not need the file lock. Snapshot is freed
+    // by the last user, mutex protects only the pointer copy
+    mutable std::mutex subscribers_mutex_;
+    subscribers_ptr subscribers_;
+};
+
+
+/**
+ * Property file entry: read and write are serialized by the property
+ * file per handle, so the whole file lock is not taken and readers of
+ * the same property are not blocking each other
+ */
+template <typename T>
+class PropFileEntry : public FileEntry<T>
+{
+    typedef FileEntry<T> base_type;
+public:
+    PropFileEntry(std::unique_ptr<T> impl) : base_type(std::move(impl)) {}
+
+    virtual int read(path_ptr, char* buf, size_t size,
+                     off_t offset, struct fuse_file_info &fi)
+    {
+        return this->impl_->read(buf, size, offset, fi);
+    }
+
+    virtual int write(path_ptr, const char* src, size_t size,
+                      off_t offset, struct fuse_file_info &fi)
+    {
+        return this->impl_->write(src, size, offset, fi);
+    }
+
+    virtual int read_ref(path_ptr, size_t size, off_t offset,
+                         struct fuse_file_info &fi, ReadRef &dst)
+    {
+        return this->impl_->read_ref(size, offset, fi, dst);
+    }
+};
+
+template <typename T>
+std::unique_ptr<PropFileEntry<T> > mk_prop_file_entry(std::unique_ptr<T> p)
+{
+    return make_unique<PropFileEntry<T> >(std::move(p));
+}
+
+class EventsHandle : public FileHandle, public cor::Mutex
+{
+public:
+    EventsHandle() : pos(0), is_blocking(true) {}
+
+    EventsHandle& operator = (EventsHandle const &from)
+    {
+        FileHandle::operator = (from);
+        pos.store(from.pos.load());
+        is_blocking = from.is_blocking;
+        return *this;
+    }
+
+    // poll checks position w/o the handle lock held by blocked reader
+    std::atomic<unsigned long> pos;
+    bool is_blocking;
+};
+
+/**
+ * Read-only file streaming change records of the watched properties
+ * from EventStream. It is not seekable and is not cached by kernel.
+ * Blocking read occupies fuse thread until record is appended, so
+ * non-blocking reads and poll are preferable
+ */
+class EventStreamFile
+    : public DefaultFile<EventStreamFile, EventsHandle, cor::Mutex>
+{
+    typedef DefaultFile<EventStreamFile, EventsHandle,
+                        cor::Mutex> base_type;
+public:
+    EventStreamFile(EventStream &stream)
+        : base_type(0444), stream_(stream)
+    {}
+
+    int open(struct fuse_file_info &fi)
+    {
+        if ((fi.flags & O_ACCMODE) != O_RDONLY)
+            return -EACCES;
+
+        int rc = base_type::open(fi);
+        if (rc < 0)
+            return rc;
+        auto h = handles_.get(fi.fh);
+        h->pos = stream_.attach();
+        h->is_blocking = !(fi.flags & O_NONBLOCK);
+        fi.direct_io = 1;
+        fi.nonseekable = 1;
+        return rc;
+    }
+
+    int release(struct fuse_file_info &fi)
+    {
+        auto h = handles_.get(fi.fh);
+        if (h)
+            stream_.detach(h);
+        return base_type::release(fi);
+    }
+
+    /// called w/o the file lock (see PropFileEntry)
+    int read(char* buf, size_t size,
+             off_t, struct fuse_file_info &fi)
+    {
+        auto h = handle_acquire(fi);
+        if (!h)
+            return -EBADF;
+        auto l(cor::wlock(*h));
+        auto pos = h->pos.load();
+        int rc = stream_.read(pos, buf, size, h->is_blocking);
+        h->pos.store(pos);
+        return rc;
+    }
+
+    /// records are collected into the reader buffer
+    int read_ref(size_t, off_t, struct fuse_file_info &, ReadRef &)
+    {
+        return -ENOTSUP;
+    }
+
+    int write(const char*, size_t, off_t, struct fuse_file_info &)
+    {
+        return -EACCES;
+    }
+
+    size_t size() const
+    {
+        return 0;
+    }
+
+	int poll(struct fuse_file_info &fi,
+             poll_handle_type &ph, unsigned *reventsp)
+    {
+        auto h = handles_.get(fi.fh);
+        if (!h)
+            return -EINVAL;
+        if (stream_.poll(h, h->pos, ph) && reventsp)
+            *reventsp |= POLLIN;
+        return 0;
+    }
+
+private:
+
+    handle_ptr handle_acquire(struct fuse_file_info &fi)
+    {
+        auto l(cor::wlock(*this));
+        return handles_.acquire(fi.fh);
+    }
+
+    EventStream &stream_;
+};
+
+static entry_ptr mk_events_file(EventStream &stream)
+{
+    auto file = make_unique<EventStreamFile>(stream);
+    file->cache_timeouts_set(cache_policy.continuous_timeouts());
+    return mk_prop_file_entry(std::move(file));
+}
+
+class TextHandle : public FileHandle
+{
+public:
+    std::string data;
+};
+
+/**
+ * Read-only file with the text generated on open, so each reader
+ * gets consistent content. Size is not known in advance, so data is
+ * not cached by kernel
+ */
+class GeneratedTextFile
+    : public DefaultFile<GeneratedTextFile, TextHandle, cor::Mutex>
+{
+    typedef DefaultFile<GeneratedTextFile, TextHandle,
+                        cor::Mutex> base_type;
+public:
+    typedef std::function<void (std::ostream &)> generator_type;
+
+    GeneratedTextFile(generator_type const &generate)
+        : base_type(0444), generate_(generate)
+    {}
+
+    int open(struct fuse_file_info &fi)
+    {
+        if ((fi.flags & O_ACCMODE) != O_RDONLY)
+            return -EACCES;
+
+        int rc = base_type::open(fi);
+        if (rc < 0)
+            return rc;
+        std::ostringstream out;
+        generate_(out);
+        handles_.get(fi.fh)->data = out.str();
+        fi.direct_io = 1;
+        return rc;
+    }
+
+    int read(char* buf, size_t size,
+             off_t offset, struct fuse_file_info &fi)
+    {
+        auto h = handles_.get(fi.fh);
+        if (!h)
+            return -EBADF;
+        auto const &data = h->data;
+        if (offset < 0 || (size_t)offset >= data.size() || !size)
+            return 0;
+
+        size_t count = std::min((size_t)(data.size() - offset), size);
+        memcpy(buf, &data[offset], count);
+        return count;
+    }
 
-    /// used as a bridge between C callback and C++ object
-    static void slot_on_changed
-    (struct statefs_slot *slot, struct statefs_property *)
+    int write(const char*, size_t, off_t, struct fuse_file_info &)
     {
-        auto self = cor::member_container(slot, &DiscretePropFile::slot_);
-        self->notify();
+        return -EACCES;
     }
 
-public:
-    DiscretePropFile(PluginNsDir *, std::unique_ptr<Property>, int);
-    virtual ~DiscretePropFile();
-
-	int poll(struct fuse_file_info &, poll_handle_type &, unsigned *);
-    int open(struct fuse_file_info &);
-    int release(struct fuse_file_info &fi);
-    void notify();
+    size_t size() const
+    {
+        return 0;
+    }
 
-    int getattr(struct stat *buf)
+	int poll(struct fuse_file_info &,
+             poll_handle_type &, unsigned *reventsp)
     {
-        return ContinuousPropFile::base_type::getattr(buf);
+        if (reventsp)
+            *reventsp |= POLLIN;
+        return 0;
     }
 
 private:
-    PluginNsDir *parent_;
-    std::atomic_flag is_notify_;
-    statefs_slot slot_;
+    generator_type generate_;
 };
 
-
 template <typename LoadT, typename ... Args>
 std::unique_ptr<PluginLoadFile<LoadT> > mk_loader(LoadT loader, Args&& ... args)
 {
@@ -462,16 +1450,43 @@ public:
     void load_fake();
 
     bool enqueue(std::packaged_task<void()>);
+    bool enqueue_at(long long, std::function<void()>);
+    NotifyStats & stats();
+
+    /// property change record for event streams
+    void event(char const *, unsigned long, std::string const &);
+    /// change record is generated later, values of properties
+    /// changed together are read at once
+    void event_changed(DiscretePropFile *, unsigned long);
+    /// generate inotify event for the property file
+    void touch(char const *);
+    void events_watch(bool);
+    void events_stop();
 
 private:
 
     void add_loader_file(std::shared_ptr<config::Property> const &
                        , std::function<void()> const& plugin_load);
-    void add_prop_file(std::unique_ptr<Property>);
+    entry_ptr mk_prop_file(std::unique_ptr<Property>
+                           , config::Property const &);
+    static entry_ptr mk_default_file(std::string const &, int);
+    void events_flush();
+    void values_read_many(std::vector<std::pair<DiscretePropFile*
+                          , unsigned long> > const &
+                          , std::vector<value_snapshot_ptr> &);
 
     PluginDir *parent_;
     info_ptr info_;
     std::unique_ptr<Namespace> ns_;
+    std::function<void()> plugin_load_;
+    EventStream events_;
+    entry_ptr events_file_;
+    // to be watched by event streams, it is filled on load
+    std::vector<DiscretePropFile*> discrete_;
+    // changed properties and change sequence numbers waiting for
+    // the records to be generated (protected by changed_mutex_)
+    std::mutex changed_mutex_;
+    std::vector<std::pair<DiscretePropFile*, unsigned long> > changed_;
 };
 
 /// extracted into separate class from PluginDir to initialize later
@@ -479,8 +1494,13 @@ private:
 class PluginStorage
 {
 protected:
+    PluginStorage() : task_queue_(SerialQueue::create()) {}
+
     std::shared_ptr<ProviderBridge> provider_;
-    cor::TaskQueue task_queue_;
+    // provider notifications are processed in order by the shared
+    // executor
+    std::shared_ptr<SerialQueue> task_queue_;
+    NotifyStats stats_;
 };
 
 class PluginsDir;
@@ -497,22 +1517,61 @@ public:
 
     bool enqueue(std::packaged_task<void()> task)
     {
-        return task_queue_.enqueue(std::move(task));
+        return task_queue_->enqueue(std::move(task));
+    }
+
+    /// task is enqueued at the specified time (monotonic_ms)
+    bool enqueue_at(long long at, std::function<void()> task)
+    {
+        return task_queue_->enqueue_at(at, std::move(task));
     }
 
     void stop()
     {
-        task_queue_.stop();
+        task_queue_->stop();
+        namespaces_for_each(&PluginNsDir::events_stop);
+    }
+
+    void events_watch(bool is_on)
+    {
+        namespaces_for_each(&PluginNsDir::events_watch, is_on);
+    }
+
+    std::string name() const
+    {
+        return info_->value();
+    }
+
+    /// change notifications statistics of all provider properties
+    NotifyStats & stats()
+    {
+        return stats_;
     }
 
 private:
 
+    template <typename OpT, typename ... Args>
+    void namespaces_for_each(OpT op, Args&& ... args)
+    {
+        auto table = children.snapshot();
+        for (auto &d : table->items()) {
+            if (d.second.type != child_dir)
+                continue;
+            auto p = dir_entry_impl<PluginNsDir>(d.second.entry);
+            if (p)
+                std::mem_fn(op)(p.get(), std::forward<Args>(args)...);
+        }
+    }
+
     template <typename OpT, typename ... Args>
     void namespaces_init(OpT op, Args&& ... args)
     {
-        for (auto &d : dirs) {
+        auto table = children.snapshot();
+        for (auto &d : table->items()) {
+            if (d.second.type != child_dir)
+                continue;
             trace() << "Init ns " << d.first << std::endl;
-            auto p = dir_entry_impl<PluginNsDir>(d.second);
+            auto p = dir_entry_impl<PluginNsDir>(d.second.entry);
             if (!p)
                 throw std::logic_error("Can't cast to namespace???");
             std::mem_fn(op)(p.get(), std::forward<Args>(args)...);
@@ -526,11 +1585,21 @@ private:
 };
 
 DiscretePropFile::DiscretePropFile
-(PluginNsDir *parent, std::unique_ptr<Property> prop, int mode)
+(PluginNsDir *parent, std::unique_ptr<Property> prop, int mode
+ , long min_interval)
     : ContinuousPropFile(std::move(prop), mode)
     , parent_(parent)
     , is_notify_(ATOMIC_FLAG_INIT)
     , slot_({&DiscretePropFile::slot_on_changed})
+    , min_interval_(min_interval)
+    , last_notify_(0)
+    , changed_at_(0)
+    , seq_(0)
+    , version_(0)
+    , watchers_(0)
+    , watch_handle_(0)
+    , is_fsnotify_(false)
+    , subscribers_(std::make_shared<subscribers_type>())
 {
 }
 
@@ -543,7 +1612,11 @@ DiscretePropFile::~DiscretePropFile()
         trace() << "DiscretePropFile " << prop_->name()
                 << " was not released?\n";
         prop_->disconnect();
+    } else if (is_tracked()) {
+        prop_->disconnect();
     }
+    if (watch_handle_)
+        prop_->close(watch_handle_);
     slot_.on_changed = nullptr;
 }
 
@@ -557,52 +1630,303 @@ int DiscretePropFile::poll(struct fuse_file_info &fi,
         return -EINVAL;
     }
 
-    if (p->is_changed() && reventsp) {
+    // handle is also updated by notification w/o the file lock
+    auto l(cor::wlock(*p));
+    // readiness is reported once for each change not seen through
+    // the handle
+    auto seq = seq_.load(std::memory_order_acquire);
+    if (p->seen() != seq && reventsp) {
         *reventsp |= POLLIN;
+        p->seen_set(seq);
     }
 
     p->poll(ph);
     return 0;
 }
 
+int DiscretePropFile::read(char* buf, size_t size,
+                           off_t offset, struct fuse_file_info &fi)
+{
+    auto h = handle_acquire(fi);
+    if (!h)
+        return -EBADF;
+    auto l(cor::wlock(*h));
+    int rc = value_capture(*h, offset);
+    if (rc < 0)
+        return rc;
+
+    auto const &value = h->value();
+    if (!value)
+        return prop_->read(h->get(), buf, size, offset);
+
+    return value->read(buf, size, offset);
+}
+
+/// value snapshot (copied or provider view) is replied directly
+int DiscretePropFile::read_ref(size_t size, off_t offset,
+                               struct fuse_file_info &fi, ReadRef &dst)
+{
+    auto h = handle_acquire(fi);
+    if (!h)
+        return -EBADF;
+    auto l(cor::wlock(*h));
+    int rc = value_capture(*h, offset);
+    if (rc < 0)
+        return rc;
+
+    return value_ref(*h, size, offset, dst);
+}
+
+/// value is captured on read from the beginning, should be called
+/// with the handle lock held
+int DiscretePropFile::value_capture(handle_type &h, off_t offset)
+{
+    if (offset)
+        return 0;
+
+    // cached snapshot can be captured before the sequence of the
+    // change it reflects is bumped (notification is postponed by
+    // rate limiting), so the sequence is loaded before the value
+    auto seq = seq_.load(std::memory_order_acquire);
+    value_snapshot_ptr value;
+    int rc = value_get(h.get(), value);
+    if (rc < 0)
+        return rc;
+    h.value_set(value);
+    h.seen_set(std::max(seq, value->seq));
+    return 0;
+}
+
+/// value is read from provider only once after each change, it is
+/// valid only while provider notifies about changes, so it is reset
+/// when the last handle is released
+int DiscretePropFile::value_get(intptr_t h, value_snapshot_ptr &res)
+{
+    std::lock_guard<std::mutex> lock(value_mutex_);
+    return value_get_(h, res);
+}
+
+/// value for event streams
+int DiscretePropFile::value_watched(value_snapshot_ptr &res)
+{
+    std::lock_guard<std::mutex> lock(value_mutex_);
+    return watch_handle_ ? value_get_(watch_handle_, res) : -EBADF;
+}
+
+bool DiscretePropFile::value_cached(value_snapshot_ptr &res)
+{
+    std::lock_guard<std::mutex> lock(value_mutex_);
+    auto version = version_.load(std::memory_order_acquire);
+    if (!value_ || value_->version != version)
+        return false;
+    res = value_;
+    return true;
+}
+
+/// slice buffer is set to the snapshot data. Value is read from the
+/// beginning, so the buffer is big enough for the whole value if the
+/// property reports its size
+std::shared_ptr<ValueSnapshot> DiscretePropFile::value_prepare
+(statefs_slice &slice)
+{
+    auto seq = seq_.load(std::memory_order_acquire);
+    auto version = version_.load(std::memory_order_acquire);
+    auto value = std::make_shared<ValueSnapshot>(seq, version);
+    value->data.resize(std::max(prop_->size(), (size_t)64) + 1);
+    memset(&slice, 0, sizeof(slice));
+    slice.property = prop_->get();
+    slice.data = &value->data[0];
+    slice.size = value->data.size();
+    return value;
+}
+
+void DiscretePropFile::value_store(value_snapshot_ptr const &value)
+{
+    std::lock_guard<std::mutex> lock(value_mutex_);
+    if (value->version == version_.load(std::memory_order_acquire))
+        value_ = value;
+}
+
+/// should be called with value_mutex_ held
+int DiscretePropFile::value_get_(intptr_t h, value_snapshot_ptr &res)
+{
+    // value read reflects at least all changes notified before
+    auto seq = seq_.load(std::memory_order_acquire);
+    auto version = version_.load(std::memory_order_acquire);
+    if (value_ && value_->version == version) {
+        res = value_;
+        return 0;
+    }
+
+    auto value = std::make_shared<ValueSnapshot>(seq, version);
+    int rc = value->load(*prop_, h);
+    if (rc < 0)
+        return rc;
+    value_ = value;
+    res = value_;
+    return 0;
+}
+
+void DiscretePropFile::value_reset()
+{
+    std::lock_guard<std::mutex> lock(value_mutex_);
+    value_.reset();
+}
+
+/// is connected to provider, should be called with lock held
+bool DiscretePropFile::is_tracked() const
+{
+    return !handles_.empty() || watchers_.load() || is_fsnotify_;
+}
+
+void DiscretePropFile::fsnotify_track()
+{
+    auto l(cor::wlock(*this));
+    if (!is_tracked())
+        prop_->connect(&slot_);
+    is_fsnotify_ = true;
+}
+
+void DiscretePropFile::watch(bool is_on)
+{
+    auto l(cor::wlock(*this));
+    if (is_on) {
+        if (!is_tracked())
+            prop_->connect(&slot_);
+        if (watchers_.fetch_add(1))
+            return;
+        std::lock_guard<std::mutex> lock(value_mutex_);
+        watch_handle_ = prop_->open(O_RDONLY);
+    } else {
+        if (watchers_.fetch_sub(1) != 1)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(value_mutex_);
+            if (watch_handle_)
+                prop_->close(watch_handle_);
+            watch_handle_ = 0;
+        }
+        if (!is_tracked()) {
+            prop_->disconnect();
+            value_reset();
+        }
+    }
+}
+
 int DiscretePropFile::open(struct fuse_file_info &fi)
 {
-    if (handles_.empty()) {
+    if (!is_tracked()) {
         prop_->connect(&slot_);
     }
 
-    return ContinuousPropFile::open(fi);
+    int rc = ContinuousPropFile::open(fi);
+    if (rc < 0)
+        return rc;
+
+    subscribers_update();
+    if (cache_policy.is_discrete_data_kept())
+        fi.keep_cache = 1;
+    return rc;
 }
 
 int DiscretePropFile::release(struct fuse_file_info &fi)
 {
+    // excluding handle before release, so it is not referenced by
+    // the snapshot and can be reused by the pool
+    auto h = handle(fi);
+    if (h)
+        subscribers_update(h);
+
     int rc = ContinuousPropFile::release(fi);
-    if (handles_.empty())
+    if (!is_tracked()) {
         prop_->disconnect();
+        // changes are not tracked anymore
+        value_reset();
+    }
 
     return rc;
 }
 
+/// changes are coalesced: while notification is pending new ones
+/// are dropped. If rate is limited, notification is postponed until
+/// min_interval_ passes since the last one, so the last change is
+/// always delivered
 void DiscretePropFile::notify()
 {
-    auto fn = [this]() {
-        // CALL is originated from provider, so acquire lock
-        auto l(cor::wlock(*this));
-        update_time(modification_time_bit | change_time_bit | access_time_bit);
-        if (handles_.empty())
-            return;
-        std::list<handle_ptr> snapshot;
-        for (auto const &h : handles_)
-            snapshot.push_back(h.second);
-        l.unlock();
-        for (auto h : snapshot)
-            h->notify(*this);
-
-        is_notify_.clear(std::memory_order_release);
-    };
-    if (!is_notify_.test_and_set(std::memory_order_acquire)) {
-        parent_->enqueue(std::packaged_task<void()>{fn});
+    auto &stats = parent_->stats();
+    stats.changes.fetch_add(1, std::memory_order_relaxed);
+    version_.fetch_add(1, std::memory_order_release);
+    if (is_notify_.test_and_set(std::memory_order_acquire)) {
+        stats.coalesced.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    changed_at_ = monotonic_us();
+    auto fn = [this]() { notify_handles(); };
+    bool is_enqueued;
+    auto at = last_notify_ + min_interval_;
+    if (min_interval_ && at > monotonic_ms()) {
+        stats.delayed.fetch_add(1, std::memory_order_relaxed);
+        is_enqueued = parent_->enqueue_at(at, fn);
+    } else {
+        is_enqueued = parent_->enqueue(std::packaged_task<void()>{fn});
     }
+    if (!is_enqueued)
+        stats.dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void DiscretePropFile::notify_handles()
+{
+    auto &stats = parent_->stats();
+    auto changed_at = changed_at_;
+    stats.queued.add(monotonic_us() - changed_at);
+    if (min_interval_)
+        last_notify_ = monotonic_ms();
+    // changes happened from now on should be delivered again
+    is_notify_.clear(std::memory_order_release);
+
+    // CALL is originated from provider, so acquire lock
+    auto l(cor::wlock(*this));
+    update_time(modification_time_bit | change_time_bit | access_time_bit);
+    l.unlock();
+    auto seq = seq_.fetch_add(1, std::memory_order_release) + 1;
+    if (watchers_.load())
+        parent_->event_changed(this, seq);
+    // attributes (and data if it is kept) are cached by kernel
+    // for a long time. Invalidation should be done before
+    // notifying pollers, also it can wait for pending reads, so
+    // lock should not be held
+    cache_invalidate(cache_policy.is_discrete_data_kept() ? 0 : -1, 0);
+    auto subscribers = subscribers_get();
+    for (auto const &h : *subscribers)
+        poll_wakeups.add(h->changed(*h));
+    poll_wakeups.commit();
+    stats.delivered.add(monotonic_us() - changed_at);
+
+    if (fsnotify_compat.is_enabled)
+        parent_->touch(prop_->name());
+}
+
+/// called under the file lock
+void DiscretePropFile::subscribers_update(handle_type const *removed)
+{
+    auto subscribers = std::make_shared<subscribers_type>();
+    subscribers->reserve(handles_.size());
+    handles_.for_each([&subscribers, removed](handle_ptr const &h) {
+            if (h.get() != removed)
+                subscribers->push_back(h);
+        });
+    // replaced snapshot is released after the mutex is unlocked
+    subscribers_ptr old;
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    old.swap(subscribers_);
+    subscribers_ = subscribers;
+}
+
+DiscretePropFile::subscribers_ptr DiscretePropFile::subscribers_get() const
+{
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    return subscribers_;
 }
 
 
@@ -610,16 +1934,126 @@ PluginNsDir::PluginNsDir
 (PluginDir *parent, info_ptr info, std::function<void()> const& plugin_load)
     : parent_(parent)
     , info_(info)
+    , plugin_load_(plugin_load)
+    , events_file_(mk_events_file(events_))
 {
+    cache_timeouts_set(cache_policy.structure_timeouts());
+    events_.watch_set([this](bool is_on) { events_watch(is_on); });
+    children.add(events_file_name, child_file, events_file_);
     for (auto prop : info->props_)
         add_loader_file(prop, plugin_load);
 }
 
+void PluginNsDir::event(char const *name, unsigned long seq
+                        , std::string const &value)
+{
+    events_.append(name, seq, value);
+    if (root_events().is_watched())
+        root_events().append(info_->value() + "/" + name, seq, value);
+}
+
+/// the first change enqueues records generation into the provider
+/// queue, changes notified before it is executed are handled together
+void PluginNsDir::event_changed(DiscretePropFile *file, unsigned long seq)
+{
+    std::unique_lock<std::mutex> lock(changed_mutex_);
+    changed_.push_back(std::make_pair(file, seq));
+    if (changed_.size() > 1)
+        return;
+    lock.unlock();
+
+    auto fn = [this]() { events_flush(); };
+    if (!enqueue(std::packaged_task<void()>{fn})) {
+        lock.lock();
+        changed_.clear();
+    }
+}
+
+void PluginNsDir::events_flush()
+{
+    std::vector<std::pair<DiscretePropFile*, unsigned long> > changed;
+    {
+        std::lock_guard<std::mutex> lock(changed_mutex_);
+        changed.swap(changed_);
+    }
+    std::vector<value_snapshot_ptr> values(changed.size());
+    if (changed.size() > 1 && ns_ && ns_->has_read_many())
+        values_read_many(changed, values);
+
+    for (size_t i = 0; i < changed.size(); ++i) {
+        auto file = changed[i].first;
+        auto &value = values[i];
+        if (value || file->value_watched(value) >= 0)
+            event(file->name(), changed[i].second, value->str());
+    }
+}
+
+/// values are read with a single provider call, not cached and
+/// possibly truncated values are left to be read one by one
+void PluginNsDir::values_read_many
+(std::vector<std::pair<DiscretePropFile*, unsigned long> > const &changed
+ , std::vector<value_snapshot_ptr> &values)
+{
+    std::vector<statefs_slice> slices;
+    std::vector<std::shared_ptr<ValueSnapshot> > snapshots;
+    std::vector<size_t> positions;
+    for (size_t i = 0; i < changed.size(); ++i) {
+        if (changed[i].first->value_cached(values[i]))
+            continue;
+        slices.push_back(statefs_slice());
+        snapshots.push_back(changed[i].first->value_prepare(slices.back()));
+        positions.push_back(i);
+    }
+    if (slices.size() < 2)
+        return;
+
+    int rc = ns_->read_many(&slices[0], slices.size());
+    if (rc != (int)slices.size()) {
+        trace() << "read_many failed: " << rc << std::endl;
+        return;
+    }
+    for (size_t i = 0; i < slices.size(); ++i) {
+        auto const &slice = slices[i];
+        if (slice.len < 0 || (size_t)slice.len >= slice.size)
+            continue;
+        auto &value = snapshots[i];
+        value->data.resize(slice.len);
+        auto pos = positions[i];
+        values[pos] = value;
+        changed[pos].first->value_store(values[pos]);
+    }
+}
+
+/// properties can be watched only after provider is loaded
+void PluginNsDir::events_watch(bool is_on)
+{
+    if (is_on)
+        plugin_load_();
+    auto lock(cor::wlock(*this));
+    for (auto file : discrete_)
+        file->watch(is_on);
+}
+
+void PluginNsDir::events_stop()
+{
+    events_.stop();
+}
+
 bool PluginNsDir::enqueue(std::packaged_task<void()> task)
 {
     return parent_->enqueue(std::move(task));
 }
 
+bool PluginNsDir::enqueue_at(long long at, std::function<void()> task)
+{
+    return parent_->enqueue_at(at, std::move(task));
+}
+
+NotifyStats & PluginNsDir::stats()
+{
+    return parent_->stats();
+}
+
 
 void PluginNsDir::add_loader_file
 (std::shared_ptr<config::Property> const &prop
@@ -638,50 +2072,68 @@ void PluginNsDir::add_loader_file
     add_file(name, mk_file_entry(mk_loader(load_get, prop->mode(), 1024)));
 }
 
-void PluginNsDir::add_prop_file(std::unique_ptr<Property> prop)
+/// file with the constant default value for the absent property
+entry_ptr PluginNsDir::mk_default_file(std::string const &value, int mode)
+{
+    auto file = make_unique<BasicTextFile<> >(value, mode);
+    file->cache_timeouts_set(cache_policy.structure_timeouts());
+    return mk_file_entry(std::move(file));
+}
+
+entry_ptr PluginNsDir::mk_prop_file(std::unique_ptr<Property> prop
+                                     , config::Property const &cfg)
 {
-    std::string name = prop->name();
     auto mode = prop->mode();
     if (prop->is_discrete()) {
         auto file = make_unique<DiscretePropFile>
-            (this, std::move(prop), mode);
-        add_file(name, mk_file_entry(std::move(file)));
+            (this, std::move(prop), mode, cfg.min_interval());
+        discrete_.push_back(file.get());
+        if (fsnotify_compat.is_enabled)
+            file->fsnotify_track();
+        file->cache_timeouts_set(cache_policy.discrete_timeouts());
+        return mk_prop_file_entry(std::move(file));
     } else {
         auto file = make_unique<ContinuousPropFile>(std::move(prop), mode);
-        add_file(name, mk_file_entry(std::move(file)));
+        file->cache_timeouts_set(cache_policy.continuous_timeouts());
+        return mk_prop_file_entry(std::move(file));
     }
 }
 
 void PluginNsDir::load(std::shared_ptr<ProviderBridge> prov)
 {
     auto lock(cor::wlock(*this));
-    files.clear();
-    auto ns = make_unique<Namespace>(prov->ns(info_->value()));
+    auto ns = make_unique<Namespace>
+        (prov->ns(info_->value()), prov->io(), prov->has_read_many());
 
+    // loader files are replaced by property files at once
+    Storage::entries_type entries;
+    entries[events_file_name] = events_file_;
+    discrete_.clear();
     for (auto cfg : info_->props_) {
         std::string name = cfg->value();
-        auto prop = make_unique<Property>(prov->io(), ns->property(name));
+        auto prop = make_unique<Property>
+            (prov->io(), ns->property(name), prov->has_read_view());
         if (prop->exists()) {
-            add_prop_file(std::move(prop));
+            entries[name] = mk_prop_file(std::move(prop), *cfg);
         } else {
             std::cerr << "PROPERTY " << name << " is absent\n";
-            add_file(name, mk_file_entry
-                     (make_unique<BasicTextFile<> >
-                      (cfg->defval(), cfg->mode())));
+            entries[name] = mk_default_file(cfg->defval(), cfg->mode());
         }
     }
+    children.replace(child_file, std::move(entries));
     ns_ = std::move(ns);
 }
 
 void PluginNsDir::load_fake()
 {
     auto lock(cor::wlock(*this));
-    files.clear();
+    Storage::entries_type entries;
+    entries[events_file_name] = events_file_;
     for (auto prop : info_->props_) {
         std::string name = prop->value();
-        add_file(name, mk_file_entry
-                 (make_unique<BasicTextFile<> >(prop->defval(), prop->mode())));
+        entries[name] = mk_default_file(prop->defval(), prop->mode());
     }
+    children.replace(child_file, std::move(entries));
 }
 
 
@@ -696,18 +2148,54 @@ public:
     void plugin_add(PluginDir::info_ptr);
     void loader_add(loader_info_ptr);
     void stop();
+    void events_watch(bool);
+    void stats_dump(std::ostream &);
 
     std::shared_ptr<LoaderProxy> loader_get(std::string const&);
 };
 
 PluginsDir::PluginsDir()
 {
+    cache_timeouts_set(cache_policy.structure_timeouts());
 }
 
 void PluginsDir::stop()
 {
-    for (auto e: dirs)
-        dir_entry_impl<PluginDir>(e.second)->stop();
+    auto table = children.snapshot();
+    for (auto &e: table->items())
+        if (e.second.type == child_dir)
+            dir_entry_impl<PluginDir>(e.second.entry)->stop();
+}
+
+void PluginNsDir::touch(char const *name)
+{
+    std::string path("providers/");
+    path += parent_->name();
+    path += "/";
+    path += info_->value();
+    path += "/";
+    path += name;
+    fsnotify_compat.touch(path);
+}
+
+void PluginsDir::events_watch(bool is_on)
+{
+    auto table = children.snapshot();
+    for (auto &e: table->items())
+        if (e.second.type == child_dir)
+            dir_entry_impl<PluginDir>(e.second.entry)->events_watch(is_on);
+}
+
+void PluginsDir::stats_dump(std::ostream &dst)
+{
+    auto table = children.snapshot();
+    for (auto &e: table->items()) {
+        if (e.second.type != child_dir)
+            continue;
+        auto p = dir_entry_impl<PluginDir>(e.second.entry);
+        if (p)
+            dst << "[" << p->name() << "]\n" << p->stats();
+    }
 }
 
 void PluginsDir::plugin_add(PluginDir::info_ptr p)
@@ -715,7 +2203,7 @@ void PluginsDir::plugin_add(PluginDir::info_ptr p)
     auto lock(cor::wlock(*this));
     auto name = p->value();
     trace() << "Plugin " << name << std::endl;
-    if (dirs.find(name)) {
+    if (children.find(name, child_dir)) {
         std::cerr << "There is already a plugin " << name << "...skipping\n";
         return;
     }
@@ -757,6 +2245,7 @@ PluginDir::PluginDir(PluginsDir *parent, info_ptr info)
     : info_(load_namespaces(info))
     , parent_(parent)
 {
+    cache_timeouts_set(cache_policy.structure_timeouts());
 }
 
 void PluginDir::load()
@@ -782,17 +2271,27 @@ void PluginDir::load()
 NamespaceDir::NamespaceDir
 (PluginDir::info_ptr p, PluginNsDir::info_ptr ns)
 {
-    Path path = {"..", "..", "providers", p->value(), ns->value()};
+    // symlinks are created with the same cache policy
+    cache_timeouts_set(cache_policy.structure_timeouts());
+    std::vector<std::string> path
+        = {"..", "..", "providers", p->value(), ns->value()};
     for (auto prop : ns->props_) {
         path.push_back(prop->value());
         add_symlink(prop->value(), boost::algorithm::join(path, "/"));
         path.pop_back();
     }
+    path.push_back(events_file_name);
+    add_symlink(events_file_name, boost::algorithm::join(path, "/"));
 }
 
 class NamespacesDir : public RODir<DirFactory, FileFactory, cor::Mutex>
 {
 public:
+    NamespacesDir()
+    {
+        cache_timeouts_set(cache_policy.structure_timeouts());
+    }
+
     void plugin_add(PluginDir::info_ptr p)
     {
         auto lock(cor::wlock(*this));
@@ -802,6 +2301,30 @@ public:
 };
 
 
+/**
+ * Read-only server diagnostics: notification statistics per provider
+ * and poll wakeups counters
+ */
+class DiagnosticsDir : public RODir<DirFactory, FileFactory, cor::Mutex>
+{
+public:
+    DiagnosticsDir(std::shared_ptr<PluginsDir> const &plugins)
+    {
+        cache_timeouts_set(cache_policy.structure_timeouts());
+        auto notifications = [plugins](std::ostream &dst) {
+            plugins->stats_dump(dst);
+        };
+        auto poll = [](std::ostream &dst) {
+            dst << "requested " << poll_wakeups.requested()
+                << "\nsent " << poll_wakeups.sent() << "\n";
+        };
+        add_file("notifications", mk_file_entry
+                 (make_unique<GeneratedTextFile>(notifications)));
+        add_file("poll", mk_file_entry
+                 (make_unique<GeneratedTextFile>(poll)));
+    }
+};
+
 class RootDir : private config::ConfigReceiver
               , public RODir<DirFactory, FileFactory, cor::Mutex>
 {
@@ -812,9 +2335,19 @@ public:
         : plugins(new PluginsDir())
         , namespaces(new NamespacesDir())
         , before_access_(&RootDir::access_before_init)
+        , is_accessed_(false)
     {
+        cache_timeouts_set(cache_policy.structure_timeouts());
         add_dir("providers", mk_dir_entry(plugins));
         add_dir("namespaces", mk_dir_entry(namespaces));
+        add_dir("diagnostics", mk_dir_entry
+                (make_unique<DiagnosticsDir>(plugins)));
+        // watching all properties loads all providers
+        root_events().watch_set([this](bool is_on) {
+                plugins->events_watch(is_on);
+            });
+        children.add
+            (events_file_name, child_file, mk_events_file(root_events()));
     }
 
     RootDir(RootDir const&) = delete;
@@ -822,9 +2355,15 @@ public:
 
     void stop()
     {
+        root_events().stop();
         plugins->stop();
     }
 
+    void stats_dump(std::ostream &dst)
+    {
+        plugins->stats_dump(dst);
+    }
+
     void init(std::string const &cfg_dir)
     {
         cfg_dir_ = cfg_dir;
@@ -834,27 +2373,36 @@ public:
     int readdir(void* buf, fuse_fill_dir_t filler,
                 off_t offset, fuse_file_info &fi)
     {
-        (this->*before_access_)();
-        before_access_ = &RootDir::dummy;
+        before_access();
         return base_type::readdir(buf, filler, offset, fi);
     }
 
     int getattr(struct stat *stbuf)
     {
-        (this->*before_access_)();
-        before_access_ = &RootDir::dummy;
+        before_access();
         return base_type::getattr(stbuf);
     }
 
-    entry_ptr acquire(std::string const &name)
+    entry_ptr acquire(Name const &name)
     {
-        (this->*before_access_)();
-        before_access_ = &RootDir::dummy;
+        // lookup is done w/o holding the lock
+        if (!is_accessed_.load(std::memory_order_acquire)) {
+            auto l(cor::wlock(*this));
+            before_access();
+        }
         return base_type::acquire(name);
     }
 
 private:
 
+    /// should be called with lock held
+    void before_access()
+    {
+        (this->*before_access_)();
+        before_access_ = &RootDir::dummy;
+        is_accessed_.store(true, std::memory_order_release);
+    }
+
     void access_before_init()
     {
         throw cor::Error("No config set");
@@ -888,6 +2436,7 @@ private:
     std::shared_ptr<PluginsDir> plugins;
     std::shared_ptr<NamespacesDir> namespaces;
     self_fn_type before_access_;
+    std::atomic<bool> is_accessed_;
     std::unique_ptr<config::Monitor> cfg_mon_;
     std::string cfg_dir_;
 };
@@ -937,6 +2486,20 @@ struct Root {
         }
     }
 
+    /// notification statistics, providers are kept after fs is
+    /// destroyed
+    void stats_dump(std::ostream &dst)
+    {
+        if (!fs)
+            return;
+        auto entry = fs->impl();
+        if (entry) {
+            auto entry_impl = dir_entry_impl<RootDir>(entry);
+            if (entry_impl)
+                entry_impl->stats_dump(dst);
+        }
+    }
+
     impl_ptr instance()
     {
         return fs;
@@ -1066,6 +2629,7 @@ public:
             ::fuse_opt_free_args(&args);
             goto err_free;
         }
+        fsnotify_compat.mountpoint_set(mountpoint);
 
         fuse = ::fuse_new(ch, &args, op, op_size, user_data);
         ::fuse_opt_free_args(&args);
@@ -1113,6 +2677,7 @@ public:
             res = fuse_loop(fuse);
 
         //statefs_root.release();
+        fsnotify_compat.mountpoint_set(nullptr);
         fuse_teardown(fuse, mountpoint);
         if (res == -1)
             return 1;
@@ -1120,6 +2685,59 @@ public:
         return 0;
     }
 
+    /// the same as statefs_main_common but running low-level
+    /// (inode-based) fuse session
+    static int statefs_main_lowlevel(int argc, char *argv[],
+                                     const struct fuse_lowlevel_ops *op,
+                                     size_t op_size, void *user_data)
+    {
+        ::fuse_args args = FUSE_ARGS_INIT(argc, argv);
+        ::fuse_session *se = nullptr;
+        int multithreaded;
+        int foreground;
+        int res = -1;
+
+        if (::fuse_parse_cmdline(&args, &mountpoint
+                                 , &multithreaded, &foreground) == -1)
+            goto err_free;
+
+        ch = ::fuse_mount(mountpoint, &args);
+        if (!ch)
+            goto err_free;
+        fsnotify_compat.mountpoint_set(mountpoint);
+
+        se = ::fuse_lowlevel_new(&args, op, op_size, user_data);
+        if (se == NULL)
+            goto err_unmount;
+
+        if (::fuse_daemonize(foreground) == -1)
+            goto err_destroy;
+
+        if (set_signal_handlers(se) == -1)
+            goto err_destroy;
+
+        ::fuse_session_add_chan(se, ch);
+        metafuse::KernelNotifier::instance().attach(ch);
+        res = (multithreaded
+               ? ::fuse_session_loop_mt(se)
+               : ::fuse_session_loop(se));
+        metafuse::KernelNotifier::instance().detach();
+        fsnotify_compat.mountpoint_set(nullptr);
+        ::fuse_session_remove_chan(ch);
+
+    err_destroy:
+        ::fuse_session_destroy(se);
+        fuse_instance = nullptr;
+    err_unmount:
+        ::fuse_unmount(mountpoint, ch);
+        ch = nullptr;
+    err_free:
+        ::fuse_opt_free_args(&args);
+        free(mountpoint);
+        mountpoint = nullptr;
+        return (res == -1) ? 1 : 0;
+    }
+
 };
 
 ::fuse_session *FuseMain::fuse_instance = nullptr;
@@ -1323,7 +2941,44 @@ private:
     int fuse_run()
     {
         auto root = fuse();
-        return root ? root->main(params.size(), &params[0], true) : -EPERM;
+        if (!root)
+            return -EPERM;
+
+        if (opts.count("lowlevel"))
+            root->lowlevel_main_ = FuseMain::statefs_main_lowlevel;
+
+        auto p = opts.find("continuous_ttl");
+        if (p != opts.end())
+            cache_policy.continuous = ::atof(p->second.c_str());
+
+        if (opts.count("discrete_keep_cache"))
+            cache_policy.is_discrete_kept = true;
+
+        p = opts.find("notify_threads");
+        if (p != opts.end())
+            Executor::instance().threads_count_set
+                (::atoi(p->second.c_str()));
+
+        p = opts.find("poll_batch");
+        if (p != opts.end())
+            poll_wakeups.batch_size = std::max(::atoi(p->second.c_str()), 1);
+
+        p = opts.find("poll_latency");
+        if (p != opts.end())
+            poll_wakeups.latency = ::atol(p->second.c_str());
+
+        if (opts.count("inotify"))
+            fsnotify_compat.is_enabled = true;
+
+        auto rc = root->main(params.size(), &params[0], true);
+        if (opts.count("stats")) {
+            std::cerr << "Poll wakeups: requested "
+                      << poll_wakeups.requested()
+                      << ", sent " << poll_wakeups.sent() << std::endl;
+            std::cerr << "Notifications:\n";
+            statefs_root.stats_dump(std::cerr);
+        }
+        return rc;
     }
 
     int main()
@@ -1365,7 +3020,25 @@ private:
                           "\t\tunregister plugin_path\n"
                           "\t\tregister plugin_path\n"
                           "\t\tcleanup\n"
-                          "\t[options]:\n");
+                          "\t[options]:\n"
+                          "\t\t-o lowlevel - use inode-based fuse API\n"
+                          "\t\t-o continuous_ttl=<seconds> - how long kernel"
+                          " caches continuous property attributes"
+                          " (lowlevel only)\n"
+                          "\t\t-o discrete_keep_cache - discrete property"
+                          " data is cached by kernel until changed"
+                          " (lowlevel only)\n"
+                          "\t\t-o notify_threads=<count> - threads"
+                          " processing provider notifications"
+                          " (default - cpu count)\n"
+                          "\t\t-o poll_batch=<count> - max number of"
+                          " poll wakeups sent at once\n"
+                          "\t\t-o poll_latency=<ms> - how long poll"
+                          " wakeups can be delayed to be batched\n"
+                          "\t\t-o inotify - discrete property changes"
+                          " produce inotify IN_ATTRIB events\n"
+                          "\t\t-o stats - print poll wakeup and"
+                          " notification statistics on exit\n");
         params.push_back("-ho");
         int fuse_rc = fuse_run();
         return (fuse_rc) ? fuse_rc : rc;
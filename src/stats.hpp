@@ -0,0 +1,142 @@
+#ifndef _STATEFS_STATS_HPP_
+#define _STATEFS_STATS_HPP_
+/**
+ * @file stats.hpp
+ * @brief Statefs server: property change notification latency
+ * statistics
+ *
+ * @author (C) 2012, 2013 Jolla Ltd. Denis Zalevskiy <denis.zalevskiy@jollamobile.com>
+ * @copyright LGPL 2.1 http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <atomic>
+#include <algorithm>
+#include <ostream>
+#include <stddef.h>
+
+namespace statefs { namespace server {
+
+/**
+ * Lock-free histogram of latencies (microseconds) with power of 2
+ * buckets: bucket 0 is for 0us, bucket N is for [2^(N-1), 2^N).
+ * Percentiles are reported as the upper bound of the bucket
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram() : count_(0), max_(0)
+    {
+        for (size_t i = 0; i < buckets_count; ++i)
+            buckets_[i].store(0, std::memory_order_relaxed);
+    }
+
+    LatencyHistogram(LatencyHistogram const&) = delete;
+    LatencyHistogram& operator = (LatencyHistogram const&) = delete;
+
+    void add(long long us)
+    {
+        if (us < 0)
+            us = 0;
+        size_t i = 0;
+        while (i < buckets_count - 1 && (1LL << i) <= us)
+            ++i;
+        buckets_[i].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        auto prev = max_.load(std::memory_order_relaxed);
+        while (prev < us && !max_.compare_exchange_weak
+               (prev, us, std::memory_order_relaxed))
+            ;
+    }
+
+    unsigned long count() const
+    {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    long long max() const
+    {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    /// p is in the range (0, 100]
+    long long percentile(unsigned p) const
+    {
+        unsigned long total = 0;
+        unsigned long counts[buckets_count];
+        for (size_t i = 0; i < buckets_count; ++i) {
+            counts[i] = buckets_[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        if (!total)
+            return 0;
+        auto rank = (total * p + 99) / 100;
+        unsigned long sum = 0;
+        for (size_t i = 0; i < buckets_count; ++i) {
+            sum += counts[i];
+            if (sum >= rank)
+                return std::min(i ? (1LL << i) - 1 : 0, max());
+        }
+        return max();
+    }
+
+private:
+    // the last bucket collects everything longer than ~18 minutes
+    static const size_t buckets_count = 32;
+
+    std::atomic<unsigned long> buckets_[buckets_count];
+    std::atomic<unsigned long> count_;
+    std::atomic<long long> max_;
+};
+
+static inline std::ostream & operator <<
+(std::ostream &dst, LatencyHistogram const &src)
+{
+    dst << "count " << src.count()
+        << " p50 " << src.percentile(50)
+        << " p99 " << src.percentile(99)
+        << " max " << src.max();
+    return dst;
+}
+
+/**
+ * Provider change notification statistics. Stages of notification
+ * are: provider reports change (on_changed) -> notification is
+ * executed by the provider queue -> pollers wakeups are committed
+ */
+struct NotifyStats
+{
+    NotifyStats() : changes(0), coalesced(0), delayed(0), dropped(0) {}
+
+    NotifyStats(NotifyStats const&) = delete;
+    NotifyStats& operator = (NotifyStats const&) = delete;
+
+    /// changes reported by provider
+    std::atomic<unsigned long> changes;
+    /// changes merged into already pending notification
+    std::atomic<unsigned long> coalesced;
+    /// notifications postponed by the rate limit
+    std::atomic<unsigned long> delayed;
+    /// notifications not enqueued because provider queue is stopped
+    std::atomic<unsigned long> dropped;
+
+    /// change reported -> notification processing is started
+    LatencyHistogram queued;
+    /// change reported -> pollers wakeups are committed
+    LatencyHistogram delivered;
+};
+
+static inline std::ostream & operator <<
+(std::ostream &dst, NotifyStats const &src)
+{
+    dst << "changes " << src.changes.load(std::memory_order_relaxed)
+        << "\ncoalesced " << src.coalesced.load(std::memory_order_relaxed)
+        << "\ndelayed " << src.delayed.load(std::memory_order_relaxed)
+        << "\ndropped " << src.dropped.load(std::memory_order_relaxed)
+        << "\nqueued_us " << src.queued
+        << "\ndelivered_us " << src.delivered << "\n";
+    return dst;
+}
+
+}} // namespace
+
+#endif // _STATEFS_STATS_HPP_
@@ -0,0 +1,88 @@
+/**
+ * @file bench-branch.cpp
+ * @brief Microbenchmark: building statefs-pp branch and looking up
+ * its children by name
+ *
+ * @author (C) 2013 Jolla Ltd. Denis Zalevskiy <denis.zalevskiy@jollamobile.com>
+ * @copyright LGPL 2.1 http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <statefs/property.hpp>
+#include <statefs/provider.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace statefs;
+
+class BenchNamespace : public Namespace
+{
+public:
+    BenchNamespace(char const *name) : Namespace(name) {}
+    virtual void release() {}
+};
+
+template <typename FnT>
+double measure(size_t count, FnT fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+        fn(i);
+    auto end = std::chrono::steady_clock::now();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>
+        (end - start).count();
+    return (double)ns / count;
+}
+
+int main()
+{
+    static const size_t count = 1000000;
+    size_t found = 0;
+
+    for (size_t size = 10; size <= 10000; size *= 10) {
+        std::vector<std::string> names;
+        for (size_t i = 0; i < size; ++i) {
+            std::ostringstream s;
+            s << (i % 2 ? "Property" : "SomeLongerPropertyName") << i;
+            names.push_back(s.str());
+        }
+        // insertion order differs from the sorted one
+        std::random_shuffle(names.begin(), names.end());
+
+        BenchNamespace ns("ns");
+        auto build_start = std::chrono::steady_clock::now();
+        for (auto const &name : names)
+            ns << Discrete{name.c_str(), "0"};
+        ns.freeze();
+        auto build_end = std::chrono::steady_clock::now();
+        auto build_us = std::chrono::duration_cast
+            <std::chrono::microseconds>(build_end - build_start).count();
+
+        std::cout << size << " children: build " << build_us << " us"
+                  << std::endl;
+
+        statefs_branch const *b = &ns.branch;
+        auto lookup = measure(count, [&](size_t i) {
+                if (b->find(b, names[i % size].c_str()))
+                    ++found;
+            });
+        std::cout << "  lookup: " << lookup << " ns/op" << std::endl;
+
+        // binary search over sorted names, used before, kept to
+        // compare with
+        std::vector<std::string> sorted(names);
+        std::sort(sorted.begin(), sorted.end());
+        auto bsearch = measure(count, [&](size_t i) {
+                if (std::binary_search(sorted.begin(), sorted.end()
+                                       , names[i % size].c_str()))
+                    ++found;
+            });
+        std::cout << "  binary search (before): " << bsearch << " ns/op"
+                  << std::endl;
+    }
+    return found ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+/**
+ * @file bench-path.cpp
+ * @brief Microbenchmark: heap allocations and time spent per
+ * path-based metafuse operation
+ *
+ * @author (C) 2013 Jolla Ltd. Denis Zalevskiy <denis.zalevskiy@jollamobile.com>
+ * @copyright LGPL 2.1 http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <metafuse.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <list>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+
+static std::atomic<size_t> alloc_count(0);
+
+void* operator new(size_t size)
+{
+    ++alloc_count;
+    void *p = ::malloc(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    ::free(p);
+}
+
+using namespace metafuse;
+
+/// path implementation used before, kept to compare with
+class ListPath : public std::list<std::string>
+{
+public:
+    ListPath(char const *path_str)
+    {
+        std::istringstream ps(path_str + sizeof('/'));
+        char token[256];
+        while (ps.getline(token, 256 ,'/'))
+            push_back(token);
+    }
+};
+
+typedef RODir<DirFactory, FileFactory, cor::Mutex> dir_type;
+
+template <typename FnT>
+void measure(char const *name, FnT fn)
+{
+    static const size_t count = 100000;
+    auto allocs = alloc_count.load();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+        fn();
+    auto end = std::chrono::steady_clock::now();
+    allocs = alloc_count.load() - allocs;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>
+        (end - start).count();
+    std::cout << name << ": "
+              << (double)allocs / count << " allocations/op, "
+              << ns / count << " ns/op" << std::endl;
+}
+
+/// lookups from several threads concurrently, total time per lookup
+template <typename FnT>
+void measure_mt(char const *name, size_t nthreads, FnT fn)
+{
+    static const size_t count = 1000000;
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nthreads; ++i)
+        threads.push_back(std::thread([&fn]() {
+                    for (size_t j = 0; j < count; ++j)
+                        fn();
+                }));
+    for (auto &t : threads)
+        t.join();
+    auto end = std::chrono::steady_clock::now();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>
+        (end - start).count();
+    std::cout << name << ", " << nthreads << " threads: "
+              << (double)ns / (count * nthreads) << " ns/op" << std::endl;
+}
+
+int main()
+{
+    auto root = std::make_shared<dir_type>();
+    auto ns = std::make_shared<dir_type>();
+    auto battery = std::make_shared<dir_type>();
+    battery->add_file("ChargePercentage", mk_file_entry
+                      (make_unique<BasicTextFile<> >("42", 0444)));
+    battery->add_file("Level", mk_file_entry
+                      (make_unique<BasicTextFile<> >("normal", 0444)));
+    ns->add_dir("Battery", mk_dir_entry(battery));
+    root->add_dir("namespaces", mk_dir_entry(ns));
+    DirEntry<dir_type> root_entry(root);
+
+    struct fuse_file_info fi;
+    memset(&fi, 0, sizeof(fi));
+    char const *paths[] = {
+        "/namespaces/Battery/Level",
+        "/namespaces/Battery/ChargePercentage"
+    };
+
+    for (auto path : paths) {
+        std::cout << path << std::endl;
+        measure("list path (before)", [path]() {
+                std::unique_ptr<ListPath> p(new ListPath(path));
+            });
+        measure("path", [path]() {
+                Path p(path);
+            });
+        measure("getattr", [path, &root_entry]() {
+                Path p(path);
+                struct stat st;
+                root_entry.getattr(&p, &st);
+            });
+        PathCache cache;
+        Path parsed(path);
+        auto leaf = root_entry.lookup(parsed.front());
+        for (parsed.next(); !parsed.empty(); parsed.next())
+            leaf = leaf->lookup(parsed.front());
+        cache.insert(path, leaf, tree_generation_get());
+        measure("cached lookup", [path, &cache]() {
+                cache.find(path, tree_generation_get());
+            });
+        measure("read", [path, &root_entry, &fi]() {
+                Path p(path);
+                char buf[16];
+                root_entry.read(&p, buf, sizeof(buf), 0, fi);
+            });
+    }
+
+    for (size_t nthreads = 1; nthreads <= 8; nthreads *= 2)
+        measure_mt("lookup", nthreads, [&root_entry]() {
+                auto ns = root_entry.lookup("namespaces");
+                auto battery = ns->lookup("Battery");
+                battery->lookup("Level");
+            });
+    return 0;
+}
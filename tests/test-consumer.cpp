@@ -0,0 +1,131 @@
+/**
+ * @file test-consumer.cpp
+ * @brief Test for consumer::Monitor, it is executed by
+ * test-statefs.py with paths of two files of the same discrete
+ * property of the test provider
+ *
+ * @author (C) 2013 Jolla Ltd. Denis Zalevskiy <denis.zalevskiy@jollamobile.com>
+ * @copyright LGPL 2.1 http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <statefs/consumer.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+using namespace statefs::consumer;
+
+static int failed_count = 0;
+
+#define ENSURE(cond) do {                                               \
+        if (!(cond)) {                                                  \
+            std::cerr << __FILE__ << ":" << __LINE__                    \
+                      << ": failed: " << #cond << std::endl;            \
+            ++failed_count;                                             \
+        }                                                               \
+    } while (0)
+
+typedef std::vector<std::string> values_type;
+
+/// receiver collecting values, "!" is stored on error
+static receiver_type collect(values_type &dst, size_t stop_after = 0)
+{
+    return [&dst, stop_after](Status status, std::string const &v) {
+        if (status == Status::Ok) {
+            auto end = v.find_last_not_of("\n");
+            dst.push_back(v.substr(0, end == std::string::npos ? 0 : end + 1));
+        } else {
+            dst.push_back("!");
+        }
+        return (stop_after && dst.size() >= stop_after)
+            ? Flow::Stop : Flow::Continue;
+    };
+}
+
+static void write_value(std::string const &path, char const *value)
+{
+    int fd = ::open(path.c_str(), O_WRONLY);
+    ENSURE(fd >= 0);
+    if (fd < 0)
+        return;
+    ENSURE(::write(fd, value, strlen(value)) == (ssize_t)strlen(value));
+    ::close(fd);
+}
+
+/// processes changes until condition is true or ~3s timeout
+template <typename T>
+static bool process_until(Monitor &monitor, T const &condition)
+{
+    for (int i = 0; i < 30 && !condition(); ++i)
+        ENSURE(monitor.process(100) >= 0);
+    return condition();
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <property> <property>\n";
+        return 2;
+    }
+    std::string path1(argv[1]), path2(argv[2]);
+
+    Monitor monitor;
+    values_type v1, v2, v3;
+    bool is_add_on_change = false;
+    auto r1 = collect(v1);
+    ENSURE(monitor.add_path(path1, [&](Status s, std::string const &v) {
+                // receiver can add properties while changes are
+                // dispatched
+                if (is_add_on_change) {
+                    is_add_on_change = false;
+                    ENSURE(monitor.add_path(path2, collect(v3, 2)));
+                }
+                return r1(s, v);
+            }));
+    // stops after the first change
+    ENSURE(monitor.add_path(path2, collect(v2, 2)));
+
+    // initial values
+    ENSURE(process_until(monitor, [&]() {
+                return v1.size() == 1 && v2.size() == 1; }));
+    ENSURE(v1.size() && v2.size() && v1[0] == v2[0] && v1[0] != "!");
+
+    write_value(path1, "8");
+    ENSURE(process_until(monitor, [&]() {
+                return v1.size() == 2 && v2.size() == 2; }));
+    ENSURE(v1.size() == 2 && v1[1] == "8");
+    ENSURE(v2.size() == 2 && v2[1] == "8");
+
+    // the second receiver returned Flow::Stop
+    is_add_on_change = true;
+    write_value(path1, "9");
+    ENSURE(process_until(monitor, [&]() {
+                return v1.size() == 3 && v3.size() == 1; }));
+    ENSURE(v1.size() == 3 && v1[2] == "9");
+    ENSURE(v2.size() == 2);
+    ENSURE(v3.size() == 1 && v3[0] == "9");
+
+    write_value(path1, "10");
+    ENSURE(process_until(monitor, [&]() {
+                return v1.size() == 4 && v3.size() == 2; }));
+    ENSURE(v3.size() == 2 && v3[1] == "10");
+    ENSURE(v2.size() == 2);
+
+    // errors are reported to receiver, property is not added
+    values_type errors;
+    ENSURE(!monitor.add_path(path1 + ".absent", collect(errors)));
+    ENSURE(errors.size() == 1);
+    // regular files can't be polled
+    ENSURE(!monitor.add_path(argv[0], collect(errors)));
+    ENSURE(errors.size() == 2 && errors[1] == "!");
+    ENSURE(!monitor.empty());
+
+    if (failed_count)
+        std::cerr << "Failed: " << failed_count << std::endl;
+    return failed_count ? 1 : 0;
+}
@@ -45,6 +45,8 @@ struct test_prop
     int access_count;
     char buf[64];
     statefs_size_t size;
+    int attr;
+    struct statefs_slot *slot;
 };
 
 static int read_test_value
@@ -104,6 +106,21 @@ static struct test_prop props[] = {
         .write = write_test_value,
         .buf = "300",
         .size = 3
+    },
+    {
+        /* discrete, change is reported on each write */
+        .prop = {
+            .node = {
+                .type = statefs_node_prop,
+                .name = "d"
+            },
+            .default_value = STATEFS_CSTR("0")
+        },
+        .read = read_test_value,
+        .write = write_test_value,
+        .buf = "0",
+        .size = 1,
+        .attr = STATEFS_ATTR_DISCRETE | STATEFS_ATTR_WRITE
     }
 };
 
@@ -176,17 +193,22 @@ static void test_prov_release(struct statefs_node *node)
 static bool test_prov_connect
 (struct statefs_property *p, struct statefs_slot *slot)
 {
-    return false;
+    struct test_prop *self = container_of(p, struct test_prop, prop);
+    if (!(self->attr & STATEFS_ATTR_DISCRETE))
+        return false;
+    self->slot = slot;
+    return true;
 }
 
 static void test_prov_disconnect(struct statefs_property *p)
 {
+    container_of(p, struct test_prop, prop)->slot = NULL;
 }
 
 static int test_prov_getattr(struct statefs_property const* p)
 {
     int res = STATEFS_ATTR_READ;
-    return res;
+    return res | container_of(p, struct test_prop, prop)->attr;
 }
 
 
@@ -203,13 +225,13 @@ static statefs_ssize_t test_prov_size(struct statefs_property const* p)
 
 static statefs_handle_t test_prov_open(struct statefs_property *p, int mode)
 {
-    if (mode & O_WRONLY) {
+    struct test_prop *self = container_of(p, struct test_prop, prop);
+    if ((mode & O_WRONLY) && !(self->attr & STATEFS_ATTR_WRITE)) {
         errno = EINVAL;
         return 0;
     }
 
     struct test_prop_handle *h = calloc(1, sizeof(h[0]));
-    struct test_prop *self = container_of(p, struct test_prop, prop);
     h->id = self->last_handle++;
     h->p = self;
     return (statefs_handle_t)h;
@@ -227,10 +249,45 @@ static int test_prov_read(statefs_handle_t h, char *dst, statefs_size_t len, sta
 static int test_prov_write(statefs_handle_t h, char const *src, statefs_size_t len, statefs_off_t off)
 {
     struct test_prop_handle *ph = (struct test_prop_handle *)h;
+    int rc;
     if (off)
         return -EINVAL; /* no processing for off */
 
-    return ph->p->write(ph->p, src, len);
+    rc = ph->p->write(ph->p, src, len);
+    if (rc >= 0) {
+        ph->p->size = rc;
+        if (ph->p->slot)
+            ph->p->slot->on_changed(ph->p->slot, &ph->p->prop);
+    }
+    return rc;
+}
+
+/* values of read-only properties are constant and can be referenced */
+static int test_prov_read_view(statefs_handle_t h, struct statefs_view *view)
+{
+    struct test_prop_handle *ph = (struct test_prop_handle *)h;
+    if (ph->p->attr & STATEFS_ATTR_WRITE)
+        return -ENOTSUP;
+
+    view->data = ph->p->buf;
+    view->len = ph->p->size;
+    view->release = NULL;
+    return 0;
+}
+
+static int test_prov_read_many
+(struct statefs_namespace *ns, struct statefs_slice *slices
+ , statefs_size_t count)
+{
+    statefs_size_t i;
+    for (i = 0; i < count; ++i) {
+        struct statefs_slice *slice = &slices[i];
+        struct test_prop *p
+            = container_of(slice->property, struct test_prop, prop);
+        slice->attr = test_prov_getattr(slice->property);
+        slice->len = slice->data ? p->read(p, slice->data, slice->size) : 0;
+    }
+    return count;
 }
 
 static void test_prov_close(statefs_handle_t h)
@@ -260,7 +317,9 @@ static struct statefs_provider provider = {
         .size = test_prov_size,
         .close = test_prov_close,
         .connect = test_prov_connect,
-        .disconnect = test_prov_disconnect
+        .disconnect = test_prov_disconnect,
+        .read_view = test_prov_read_view,
+        .read_many = test_prov_read_many
     }
 };
 
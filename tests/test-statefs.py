@@ -26,8 +26,10 @@ from UT import test, Suite, default_main
 
 import subprocess
 from subprocess import PIPE, Popen, check_output
-import os, sys
+import os, sys, errno, re, signal
+import ctypes, struct, select
 from time import sleep
+from contextlib import contextmanager
 
 statefs_bin = None
 tests_path = None
@@ -44,10 +46,47 @@ def shell(cwd, cmd, *args):
 def mkdir(name):
     os.path.exists(name) or os.makedirs(name)
 
+def write_file(path, value):
+    fd = os.open(path, os.O_WRONLY)
+    try:
+        os.write(fd, value)
+    finally:
+        os.close(fd)
+
 def execute_rc(cmd):
     print "Execute", cmd
     return subprocess.call(cmd)
 
+IN_MODIFY = 0x2
+IN_CLOSE_WRITE = 0x8
+
+class Inotify(object):
+
+    def __init__(self):
+        self.libc = ctypes.CDLL(None, use_errno=True)
+        self.fd = self.libc.inotify_init()
+        if self.fd < 0:
+            raise OSError(ctypes.get_errno(), "inotify_init")
+
+    def add_watch(self, path, mask):
+        return self.libc.inotify_add_watch(self.fd, path, mask)
+
+    def masks(self, timeout):
+        res = []
+        r, _, _ = select.select([self.fd], [], [], timeout)
+        if not r:
+            return res
+        data = os.read(self.fd, 4096)
+        pos = 0
+        while pos < len(data):
+            wd, mask, cookie, name_len = struct.unpack_from("iIII", data, pos)
+            res.append(mask)
+            pos += 16 + name_len
+        return res
+
+    def close(self):
+        os.close(self.fd)
+
 class StateFS(Suite):
 
     def init_paths(self):
@@ -68,8 +107,8 @@ class StateFS(Suite):
         cmd = [self.server_path, "--statefs-config-dir", self.cfgdir]
         self.__cmd = lambda *params: cmd + [x for x in params]
 
-    def run_fuse_server(self):
-        cmd = self.__cmd("-f", self.mntdir)
+    def run_fuse_server(self, *options):
+        cmd = self.__cmd(*(options + ("-f", self.mntdir)))
         print "Run server:", cmd
         self.server = Popen(cmd, stdout=PIPE, stderr=PIPE)
         self.suite_teardown.append(self.terminate_server)
@@ -95,7 +134,7 @@ class StateFS(Suite):
     def initial_structure(self):
         state_dirs = os.listdir(self.mntdir)
         self.ensure_eq(set(state_dirs),
-                       set(('namespaces', 'providers')),
+                       set(('namespaces', 'providers', 'diagnostics', '.events')),
                        "basic structure")
 
     @test
@@ -144,8 +183,8 @@ class StateFS(Suite):
 
         def test_tree(root_path):
             ns1_dir = os.path.join(root_path, "ns1")
-            files = ('a', 'b', 'c')
-            self.ensure_eq(set(os.listdir(ns1_dir)), set(files),
+            files = ('a', 'b', 'c', 'd')
+            self.ensure_eq(set(os.listdir(ns1_dir)), set(files + ('.events',)),
                            "wrong files in namespace ns1 from {}", root_path)
             self.file_paths = {f : os.path.join(ns1_dir, f) for f in files}
 
@@ -154,11 +193,237 @@ class StateFS(Suite):
 
     @test
     def properties(self):
-        content = { 'a' : '1', 'b' : '20', 'c' : '300' }
+        content = { 'a' : '1', 'b' : '20', 'c' : '300', 'd' : '0' }
         [self.ensure_eq(open(fname, 'r').readline().strip(), content[name],
                         "expected file {} content", name) \
              for name, fname in self.file_paths.items()]
 
+    @test
+    def events(self):
+        def test_stream(path):
+            fd = os.open(path, os.O_RDONLY | os.O_NONBLOCK)
+            try:
+                os.read(fd, 4096)
+                self.ensure(False, "there should be no events in {}", path)
+            except OSError as e:
+                self.ensure_eq(e.errno, errno.EAGAIN,
+                               "non-blocking read of {}", path)
+            finally:
+                os.close(fd)
+
+        test_stream(os.path.join(self.providers_dir, "test", "ns1", ".events"))
+        test_stream(os.path.join(self.namespaces_dir, "ns1", ".events"))
+        test_stream(os.path.join(self.mntdir, ".events"))
+
+    def events_path(self):
+        return os.path.join(self.namespaces_dir, "ns1", ".events")
+
+    @test
+    def events_records(self):
+        def records(path, value):
+            fd = os.open(path, os.O_RDONLY)
+            try:
+                write_file(self.file_paths['d'], value)
+                return os.read(fd, 4096).splitlines()
+            finally:
+                os.close(fd)
+
+        def check(lines, name, value):
+            self.ensure_eq(len(lines), 1, "single record is expected")
+            fields = lines[0].split(' ')
+            self.ensure_eq(len(fields), 3, "record: {}", lines[0])
+            self.ensure_eq(fields[0], name, "property name")
+            self.ensure(fields[1].isdigit(), "sequence {}", fields[1])
+            self.ensure_eq(fields[2], value, "property value")
+
+        check(records(self.events_path(), '5'), 'd', '5')
+        check(records(os.path.join(self.mntdir, ".events"), '6'),
+              'ns1/d', '6')
+
+    @test
+    def events_poll(self):
+        fd = os.open(self.events_path(), os.O_RDONLY | os.O_NONBLOCK)
+        try:
+            poller = select.poll()
+            poller.register(fd, select.POLLIN)
+            self.ensure_eq(poller.poll(100), [], "no records yet")
+            write_file(self.file_paths['d'], '7')
+            self.ensure_eq(len(poller.poll(2000)), 1, "record is appended")
+            self.ensure(os.read(fd, 4096).startswith('d '), "record")
+            self.ensure_eq(poller.poll(100), [], "all records are read")
+        finally:
+            os.close(fd)
+
+    @test
+    def events_interrupt(self):
+        # blocked stream reader should be interruptible
+        reader = Popen(["cat", self.events_path()], stdout=PIPE)
+        sleep(0.5)
+        self.ensure_eq(reader.poll(), None, "reader is blocked")
+        reader.send_signal(signal.SIGINT)
+        timeout = 30
+        while reader.poll() is None and timeout:
+            sleep(0.1)
+            timeout -= 1
+        if reader.poll() is None:
+            reader.kill()
+        self.ensure(timeout > 0, "reader is not interrupted")
+
+    @test
+    def events_overrun(self):
+        # reader lagging behind gets "! lost <count>" record
+        capacity = 1024
+        path = self.file_paths['d']
+        lagging = os.open(self.events_path(), os.O_RDONLY | os.O_NONBLOCK)
+        fd = os.open(self.events_path(), os.O_RDONLY | os.O_NONBLOCK)
+        try:
+            count = 0
+            def drain():
+                res = 0
+                try:
+                    while True:
+                        for l in os.read(fd, 65536).splitlines():
+                            res += int(l.split()[2]) if l.startswith('!') else 1
+                except OSError as e:
+                    self.ensure_eq(e.errno, errno.EAGAIN, "drain")
+                return res
+            # changes can be coalesced, so writing until there are
+            # enough records
+            for i in xrange(20 * capacity):
+                write_file(path, str(i % 10))
+                if i % 64 == 0:
+                    count += drain()
+                    if count > capacity + 64:
+                        break
+            self.ensure(count > capacity, "not enough records: {}", count)
+            first = os.read(lagging, 4096).splitlines()[0]
+            self.ensure(first.startswith('! lost '),
+                        "lost record is expected, got {}", first)
+        finally:
+            os.close(fd)
+            os.close(lagging)
+
+    @test
+    def consumer_monitor(self):
+        # consumer::Monitor is tested with two files of property d
+        consumer = os.path.join(tests_path, "test-consumer")
+        rc = execute_rc([consumer, self.file_paths['d'],
+                         os.path.join(self.providers_dir, "test", "ns1", "d")])
+        self.ensure_eq(rc, 0, "consumer Monitor test")
+
+    @test
+    def inotify(self):
+        # kernel does not generate inotify events when fuse file is
+        # changed by the server, with -o inotify statefs truncates
+        # changed discrete property file to the same size producing
+        # IN_MODIFY event
+        def modify_events(value):
+            path = self.file_paths['d']
+            # provider is loaded on the first access
+            open(path).read()
+            watcher = Inotify()
+            try:
+                watcher.add_watch(path, IN_MODIFY | IN_CLOSE_WRITE)
+                write_file(path, value)
+                masks = []
+                while True:
+                    batch = watcher.masks(2)
+                    if not batch:
+                        break
+                    masks += batch
+                # own write produces IN_MODIFY and IN_CLOSE_WRITE,
+                # change reported by statefs follows them
+                closed = [i for i, m in enumerate(masks)
+                          if m & IN_CLOSE_WRITE]
+                self.ensure(len(closed) > 0, "IN_CLOSE_WRITE is expected")
+                return [m for m in masks[closed[0] + 1:] if m & IN_MODIFY]
+            finally:
+                watcher.close()
+
+        self.ensure_eq(modify_events('1'), [],
+                       "no inotify events w/o -o inotify")
+        self.terminate_server()
+        self.run_fuse_server("-o", "inotify")
+        self.ensure(len(modify_events('2')) > 0,
+                    "IN_MODIFY is expected with -o inotify")
+
+    @test
+    def diagnostics(self):
+        diag_dir = os.path.join(self.mntdir, "diagnostics")
+        self.ensure_eq(set(os.listdir(diag_dir)),
+                       set(('notifications', 'poll')),
+                       "diagnostics files")
+
+        def test_changes():
+            path = os.path.join(diag_dir, "notifications")
+            lines = [l.strip() for l in open(path).readlines()]
+            self.ensure('[test]' in lines, "test provider statistics")
+            return [int(l.split()[1]) for l in lines
+                    if l.startswith('changes ')][:1]
+
+        # changes are tracked while property file is open
+        path = self.file_paths['d']
+        fd = os.open(path, os.O_RDONLY)
+        try:
+            before = test_changes()
+            value = '11' if os.read(fd, 32).strip() != '11' else '12'
+            write_file(path, value)
+            sleep(0.2)
+            after = test_changes()
+        finally:
+            os.close(fd)
+        self.ensure(len(after) and after[0] > (before or [0])[0],
+                    "property d change should be counted")
+
+    @contextmanager
+    def provider_config(self, fn, *options):
+        cfg_path = os.path.join(self.cfgdir, "provider-test.conf")
+        cfg = open(cfg_path).read()
+        try:
+            with open(cfg_path, 'w') as f:
+                f.write(fn(cfg))
+            self.terminate_server()
+            self.run_fuse_server(*options)
+            yield
+        finally:
+            with open(cfg_path, 'w') as f:
+                f.write(cfg)
+            self.terminate_server()
+            self.run_fuse_server()
+
+    @test
+    def poll_rate_limited(self):
+        # change is reported once even if its value was read before
+        # the postponed notification is delivered
+        limit = lambda cfg: re.sub(r'(\(prop "d"[^)]*)\)',
+                                   r'\1 :min-interval 500)', cfg)
+        path = self.file_paths['d']
+        write = lambda value: write_file(path, value)
+
+        with self.provider_config(limit):
+            fd = os.open(path, os.O_RDONLY)
+            poller = select.poll()
+            poller.register(fd, select.POLLIN)
+            is_ready = lambda timeout: len(poller.poll(timeout)) > 0
+            def read():
+                os.lseek(fd, 0, os.SEEK_SET)
+                return os.read(fd, 64).strip()
+            try:
+                read()
+                # the first change is delivered at once, the next one
+                # is postponed
+                write('3')
+                self.ensure(is_ready(1000), "change is reported")
+                self.ensure_eq(read(), '3', "changed value")
+                write('4')
+                self.ensure_eq(open(path).read().strip(), '4',
+                               "value before notification")
+                self.ensure(is_ready(1500), "postponed change is reported")
+                self.ensure_eq(read(), '4', "postponed value")
+                self.ensure(not is_ready(200), "change is reported once")
+            finally:
+                os.close(fd)
+
 if __name__ == '__main__':
     tests_path = os.path.dirname(sys.argv[0])
     if len(sys.argv) == 3:
@@ -0,0 +1,249 @@
+/**
+ * @file test-statefspp.cpp
+ * @brief Unit tests for statefs-pp provider library
+ *
+ * @author (C) 2013 Jolla Ltd. Denis Zalevskiy <denis.zalevskiy@jollamobile.com>
+ * @copyright LGPL 2.1 http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <statefs/property.hpp>
+#include <statefs/provider.hpp>
+
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <stdlib.h>
+
+using namespace statefs;
+
+static int failed_count = 0;
+
+#define ENSURE(cond) do {                                               \
+        if (!(cond)) {                                                  \
+            std::cerr << __FILE__ << ":" << __LINE__                    \
+                      << ": failed: " << #cond << std::endl;            \
+            ++failed_count;                                             \
+        }                                                               \
+    } while (0)
+
+class TestNamespace : public Namespace
+{
+public:
+    TestNamespace(char const *name) : Namespace(name) {}
+    virtual void release() {}
+};
+
+class TestProvider : public AProvider
+{
+public:
+    TestProvider() : AProvider("test", nullptr) {}
+    virtual void release() {}
+};
+
+static void test_read_many()
+{
+    TestProvider provider;
+    auto ns = std::make_shared<TestNamespace>("ns");
+    auto a = create(Discrete{"a", "1"});
+    auto b = create(Analog{"b", "20"});
+    *ns << a << b;
+    provider.insert(ns);
+
+    statefs_provider *p = &provider;
+    ENSURE(statefs_has_read_many(p));
+
+    char buf[16];
+    statefs_slice slices[2];
+    memset(slices, 0, sizeof(slices));
+    slices[0].property = a.get();
+    slices[0].data = buf;
+    slices[0].size = sizeof(buf);
+    // only attributes are requested
+    slices[1].property = b.get();
+
+    ENSURE(p->io.read_many(ns.get(), slices, 2) == 2);
+    ENSURE(slices[0].attr == (STATEFS_ATTR_READ | STATEFS_ATTR_DISCRETE));
+    ENSURE(std::string(buf, slices[0].len) == "1");
+    ENSURE(slices[1].attr == STATEFS_ATTR_READ);
+    ENSURE(slices[1].len == 0);
+
+    setter(a)("300");
+    ENSURE(p->io.read_many(ns.get(), slices, 1) == 1);
+    ENSURE(std::string(buf, slices[0].len) == "300");
+
+    // value is truncated to the buffer size
+    slices[0].size = 2;
+    ENSURE(p->io.read_many(ns.get(), slices, 1) == 1);
+    ENSURE(slices[0].len == 2);
+}
+
+/// names of children in the iteration order
+static std::string child_names(statefs_branch const *b)
+{
+    std::string res;
+    auto h = b->first(b);
+    for (auto n = b->get(b, h); n; b->next(b, &h), n = b->get(b, h)) {
+        res += n->name;
+        res += " ";
+    }
+    ENSURE(b->release(b, h));
+    return res;
+}
+
+static bool is_found(statefs_branch const *b, char const *name)
+{
+    auto n = b->find(b, name);
+    return n && !strcmp(n->name, name);
+}
+
+static void test_branch()
+{
+    TestNamespace empty("empty");
+    statefs_branch const *b = &empty.branch;
+    ENSURE(child_names(b) == "");
+    ENSURE(!b->find(b, "a"));
+    empty.freeze();
+    ENSURE(child_names(b) == "");
+    ENSURE(!b->find(b, "a"));
+
+    TestNamespace ns("ns");
+    b = &ns.branch;
+    auto c = create(Discrete{"c", "1"});
+    ns << c << Discrete{"a", "2"}
+       << Discrete{"a_very_long_property_name", "3"};
+    // child with the same name is not replaced
+    ns << Discrete{"c", "4"};
+    ENSURE(child_names(b) == "a a_very_long_property_name c ");
+    ENSURE(is_found(b, "a"));
+    ENSURE(is_found(b, "a_very_long_property_name"));
+    ENSURE(b->find(b, "c") == c->get_node());
+    ENSURE(!b->find(b, "b"));
+
+    // insertion after access
+    ns << Discrete{"b", "5"};
+    ENSURE(child_names(b) == "a a_very_long_property_name b c ");
+    ENSURE(is_found(b, "b"));
+    ENSURE(b->find(b, "c") == c->get_node());
+
+    ns.freeze();
+    ENSURE(child_names(b) == "a a_very_long_property_name b c ");
+    ENSURE(is_found(b, "a"));
+    ENSURE(is_found(b, "a_very_long_property_name"));
+    ENSURE(is_found(b, "b"));
+    ENSURE(b->find(b, "c") == c->get_node());
+    ENSURE(!b->find(b, "d"));
+    ENSURE(!b->find(b, "a_very_long_property_nam"));
+
+    // frozen branch can't be changed
+    bool is_rejected = false;
+    try {
+        ns << Discrete{"d", "6"};
+    } catch (cor::Error const &) {
+        is_rejected = true;
+    }
+    ENSURE(is_rejected);
+    ENSURE(child_names(b) == "a a_very_long_property_name b c ");
+    ENSURE(!b->find(b, "d"));
+
+    // provider root is not frozen explicitly
+    TestProvider provider;
+    b = &provider.root.branch;
+    provider.insert(std::make_shared<TestNamespace>("ns2"));
+    provider.insert(std::make_shared<TestNamespace>("ns1"));
+    ENSURE(child_names(b) == "ns1 ns2 ");
+    ENSURE(is_found(b, "ns1"));
+    ENSURE(is_found(b, "ns2"));
+    ENSURE(!b->find(b, "ns"));
+}
+
+static std::string read_all(AProperty &prop)
+{
+    std::unique_ptr<APropertyAccessor> h(prop.open(O_RDONLY));
+    char buf[64];
+    int rc = h->read(buf, sizeof(buf), 0);
+    return rc >= 0 ? std::string(buf, rc) : std::string();
+}
+
+static std::string view_all(AProperty &prop)
+{
+    std::unique_ptr<APropertyAccessor> h(prop.open(O_RDONLY));
+    statefs_view view;
+    memset(&view, 0, sizeof(view));
+    if (h->read_view(&view) < 0)
+        return std::string();
+    std::string res(view.data, view.len);
+    if (view.release)
+        view.release(&view);
+    return res;
+}
+
+struct CountingSlot : public statefs_slot
+{
+    CountingSlot() : count(0)
+    {
+        on_changed = &changed;
+    }
+
+    static void changed(statefs_slot *self, statefs_property *)
+    {
+        ++static_cast<CountingSlot*>(self)->count;
+    }
+
+    int count;
+};
+
+static void test_discrete_value()
+{
+    auto l = create_value("l", 5L);
+    ENSURE(l->default_value.tag == statefs_variant_int);
+    ENSURE(l->default_value.i == 5);
+    ENSURE(l->getattr() == (STATEFS_ATTR_READ | STATEFS_ATTR_DISCRETE));
+    ENSURE(read_all(*l) == "5");
+
+    CountingSlot slot;
+    ENSURE(l->connect(&slot));
+    auto set_l = setter(l);
+    ENSURE(set_l(5) == PropertyUnchanged);
+    ENSURE(slot.count == 0);
+    ENSURE(set_l(-12) == PropertyUpdated);
+    ENSURE(slot.count == 1);
+    ENSURE(l->size() == 3);
+    ENSURE(read_all(*l) == "-12");
+    ENSURE(view_all(*l) == "-12");
+    l->disconnect();
+
+    // int is reported as long
+    auto i = create_value("i", 5);
+    ENSURE(i->default_value.tag == statefs_variant_int);
+    ENSURE(read_all(*i) == "5");
+
+    auto d = create_value("d", 0.5);
+    ENSURE(d->default_value.tag == statefs_variant_real);
+    ENSURE(read_all(*d) == "0.5");
+    auto set_d = setter(d);
+    ENSURE(set_d(0.5) == PropertyUnchanged);
+    ENSURE(set_d(1e-7) == PropertyUpdated);
+    ENSURE(read_all(*d) == "1e-07");
+    ENSURE(set_d(0.1) == PropertyUpdated);
+    ENSURE(view_all(*d) == "0.1");
+    ENSURE(set_d(1.0 / 3) == PropertyUpdated);
+    ENSURE(strtod(read_all(*d).c_str(), nullptr) == 1.0 / 3);
+
+    auto b = create_value("b", false);
+    ENSURE(b->default_value.tag == statefs_variant_bool);
+    ENSURE(read_all(*b) == "0");
+    ENSURE(setter(b)(true) == PropertyUpdated);
+    ENSURE(read_all(*b) == "1");
+    ENSURE(view_all(*b) == "1");
+}
+
+int main()
+{
+    test_branch();
+    test_read_many();
+    test_discrete_value();
+    if (failed_count)
+        std::cerr << "Failed: " << failed_count << std::endl;
+    return failed_count ? 1 : 0;
+}